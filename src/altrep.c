@@ -0,0 +1,107 @@
+#include "altrep.h"
+#include <Rversion.h>
+#include <leveldb/c.h>
+
+// ALTREP lets us return raw vectors that point directly
+// at the buffer that leveldb_get allocated, rather than copying it
+// into a fresh R vector.  The buffer belongs solely to the vector, so
+// R may write into it as it would any other unshared vector; it is
+// released with leveldb_free when the vector is garbage collected.
+//
+//   data1: external pointer to the buffer (with a finaliser)
+//   data2: length of the buffer, as a scalar double
+//
+// ALTREP arrived in R 3.5.0, but only for integer, real and string
+// vectors; raw vectors (R_make_altraw_class and its methods) need
+// R 3.6.0.
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define RLEVELDB_HAS_ALTREP
+#include <R_ext/Altrep.h>
+
+static R_altrep_class_t leveldb_raw_class;
+
+static void leveldb_raw_finalize(SEXP r_ptr) {
+  void *data = R_ExternalPtrAddr(r_ptr);
+  if (data) {
+    leveldb_free(data);
+    R_ClearExternalPtr(r_ptr);
+  }
+}
+
+static SEXP leveldb_raw_new(char *buf, size_t len) {
+  SEXP r_ptr = PROTECT(R_MakeExternalPtr(buf, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(r_ptr, leveldb_raw_finalize, TRUE);
+  SEXP r_len = PROTECT(ScalarReal((double) len));
+  SEXP ret = R_new_altrep(leveldb_raw_class, r_ptr, r_len);
+  UNPROTECT(2);
+  return ret;
+}
+
+static R_xlen_t leveldb_raw_length(SEXP x) {
+  return (R_xlen_t) REAL(R_altrep_data2(x))[0];
+}
+
+static void* leveldb_raw_dataptr(SEXP x, Rboolean writeable) {
+  return R_ExternalPtrAddr(R_altrep_data1(x));
+}
+
+static const void* leveldb_raw_dataptr_or_null(SEXP x) {
+  return R_ExternalPtrAddr(R_altrep_data1(x));
+}
+
+static Rbyte leveldb_raw_elt(SEXP x, R_xlen_t i) {
+  return ((Rbyte*) R_ExternalPtrAddr(R_altrep_data1(x)))[i];
+}
+
+static R_xlen_t leveldb_raw_get_region(SEXP x, R_xlen_t i, R_xlen_t n,
+                                       Rbyte *buf) {
+  R_xlen_t len = leveldb_raw_length(x);
+  R_xlen_t ncopy = len - i > n ? n : len - i;
+  if (ncopy > 0) {
+    memcpy(buf, (Rbyte*) R_ExternalPtrAddr(R_altrep_data1(x)) + i, ncopy);
+  }
+  return ncopy;
+}
+
+static Rboolean leveldb_raw_inspect(SEXP x, int pre, int deep, int pvec,
+                                    void (*inspect_subtree)(SEXP, int, int,
+                                                            int)) {
+  Rprintf(" leveldb_raw (len=%.0f)\n", (double) leveldb_raw_length(x));
+  return TRUE;
+}
+#endif
+
+void rleveldb_altrep_init(DllInfo *info) {
+#ifdef RLEVELDB_HAS_ALTREP
+  leveldb_raw_class = R_make_altraw_class("leveldb_raw", "rleveldb", info);
+  R_set_altrep_Length_method(leveldb_raw_class, leveldb_raw_length);
+  R_set_altrep_Inspect_method(leveldb_raw_class, leveldb_raw_inspect);
+  R_set_altvec_Dataptr_method(leveldb_raw_class, leveldb_raw_dataptr);
+  R_set_altvec_Dataptr_or_null_method(leveldb_raw_class,
+                                      leveldb_raw_dataptr_or_null);
+  R_set_altraw_Elt_method(leveldb_raw_class, leveldb_raw_elt);
+  R_set_altraw_Get_region_method(leveldb_raw_class, leveldb_raw_get_region);
+#endif
+}
+
+// Convert a buffer allocated by leveldb into an R object, taking
+// ownership of the buffer (it is always either freed or owned by the
+// returned object).  With zero_copy, values that are returned as raw
+// vectors wrap the buffer directly where ALTREP is available.
+SEXP leveldb_buffer_to_sexp(char *buf, size_t len, return_as as,
+                            bool zero_copy) {
+  bool has_nul = as != AS_RAW && memchr(buf, '\0', len) != NULL;
+#ifdef RLEVELDB_HAS_ALTREP
+  bool is_raw = as == AS_RAW || (as == AS_ANY && has_nul);
+  if (zero_copy && is_raw && len > 0) {
+    return leveldb_raw_new(buf, len);
+  }
+#endif
+  if (as == AS_STRING && has_nul) {
+    leveldb_free(buf);
+    Rf_error("Value contains embedded nul bytes; cannot return string");
+  }
+  SEXP ret = raw_string_to_sexp(buf, len, as);
+  leveldb_free(buf);
+  return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef RLEVELDB_ALTREP_H
+#define RLEVELDB_ALTREP_H
+
+#include <stdbool.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#include "support.h"
+
+void rleveldb_altrep_init(DllInfo *info);
+SEXP leveldb_buffer_to_sexp(char *buf, size_t len, return_as as,
+                            bool zero_copy);
+#endif
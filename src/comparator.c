@@ -0,0 +1,184 @@
+#include "comparator.h"
+#include <stdint.h>
+#include <string.h>
+#include "range.h"
+
+struct rleveldb_comparator {
+  comparator_type type;
+  const char *name;
+  const char *leveldb_name;
+  int (*compare)(const char *a, size_t a_len, const char *b, size_t b_len);
+  leveldb_comparator_t *comparator;
+};
+
+static int reverse_compare(const char *a, size_t a_len,
+                           const char *b, size_t b_len);
+static int natural_compare(const char *a, size_t a_len,
+                           const char *b, size_t b_len);
+static int uint64_compare(const char *a, size_t a_len,
+                          const char *b, size_t b_len);
+static uint64_t read_uint64(const char *x, size_t len);
+
+static int comparator_state_compare(void *state,
+                                    const char *a, size_t a_len,
+                                    const char *b, size_t b_len);
+static const char* comparator_state_name(void *state);
+static void comparator_state_destroy(void *state);
+
+// The bytewise comparator is leveldb's own, so has no native object
+static rleveldb_comparator comparators[COMPARATOR_COUNT] = {
+  {COMPARATOR_BYTEWISE, "bytewise", "leveldb.BytewiseComparator",
+   compare_bytes, NULL},
+  {COMPARATOR_REVERSE, "reverse", "rleveldb.ReverseBytewiseComparator",
+   reverse_compare, NULL},
+  {COMPARATOR_NATURAL, "natural", "rleveldb.NaturalComparator",
+   natural_compare, NULL},
+  {COMPARATOR_UINT64, "uint64", "rleveldb.Uint64Comparator",
+   uint64_compare, NULL}
+};
+
+void comparator_init() {
+  for (size_t i = 0; i < COMPARATOR_COUNT; ++i) {
+    rleveldb_comparator *c = comparators + i;
+    if (c->type != COMPARATOR_BYTEWISE && c->comparator == NULL) {
+      c->comparator =
+        leveldb_comparator_create(c, comparator_state_destroy,
+                                  comparator_state_compare,
+                                  comparator_state_name);
+    }
+  }
+}
+
+void comparator_cleanup() {
+  for (size_t i = 0; i < COMPARATOR_COUNT; ++i) {
+    if (comparators[i].comparator != NULL) {
+      leveldb_comparator_destroy(comparators[i].comparator); // #nocov
+      comparators[i].comparator = NULL; // #nocov
+    }
+  }
+}
+
+// NULL if there is no comparator with this name
+const rleveldb_comparator* comparator_find(const char *name) {
+  for (size_t i = 0; i < COMPARATOR_COUNT; ++i) {
+    if (strcmp(comparators[i].name, name) == 0) {
+      return comparators + i;
+    }
+  }
+  return NULL;
+}
+
+const rleveldb_comparator* comparator_get(comparator_type type) {
+  return comparators + type;
+}
+
+comparator_type comparator_type_of(const rleveldb_comparator *comparator) {
+  return comparator == NULL ? COMPARATOR_BYTEWISE : comparator->type;
+}
+
+const char* comparator_name(const rleveldb_comparator *comparator) {
+  return comparator_get(comparator_type_of(comparator))->name;
+}
+
+leveldb_comparator_t* comparator_leveldb(
+  const rleveldb_comparator *comparator) {
+  return comparator == NULL ? NULL : comparator->comparator;
+}
+
+bool comparator_is_bytewise(const rleveldb_comparator *comparator) {
+  return comparator_type_of(comparator) == COMPARATOR_BYTEWISE;
+}
+
+int comparator_compare(const rleveldb_comparator *comparator,
+                       const char *a, size_t a_len,
+                       const char *b, size_t b_len) {
+  return comparator == NULL ? compare_bytes(a, a_len, b, b_len) :
+    comparator->compare(a, a_len, b, b_len);
+}
+
+static int reverse_compare(const char *a, size_t a_len,
+                           const char *b, size_t b_len) {
+  return compare_bytes(b, b_len, a, a_len);
+}
+
+// Keys are compared as a sequence of tokens, each either a single
+// non-digit byte or a run of digits.  Runs compare by value: with
+// leading zeros skipped, a longer run is a larger number, and runs of
+// the same length compare as bytes.  Against any other byte a run
+// compares by its first digit, which keeps the order total.
+static int natural_compare(const char *a, size_t a_len,
+                           const char *b, size_t b_len) {
+  size_t i = 0, j = 0;
+  while (i < a_len && j < b_len) {
+    unsigned char ca = a[i], cb = b[j];
+    bool da = ca >= '0' && ca <= '9', db = cb >= '0' && cb <= '9';
+    if (!da || !db) {
+      if (ca != cb) {
+        return ca < cb ? -1 : 1;
+      }
+      ++i;
+      ++j;
+      continue;
+    }
+    while (i < a_len && a[i] == '0') {
+      ++i;
+    }
+    while (j < b_len && b[j] == '0') {
+      ++j;
+    }
+    size_t a_from = i, b_from = j;
+    while (i < a_len && a[i] >= '0' && a[i] <= '9') {
+      ++i;
+    }
+    while (j < b_len && b[j] >= '0' && b[j] <= '9') {
+      ++j;
+    }
+    size_t a_digits = i - a_from, b_digits = j - b_from;
+    if (a_digits != b_digits) {
+      return a_digits < b_digits ? -1 : 1;
+    }
+    int ret = a_digits == 0 ? 0 : memcmp(a + a_from, b + b_from, a_digits);
+    if (ret != 0) {
+      return ret < 0 ? -1 : 1;
+    }
+  }
+  if (i < a_len || j < b_len) {
+    return i < a_len ? 1 : -1;
+  }
+  return compare_bytes(a, a_len, b, b_len);
+}
+
+static int uint64_compare(const char *a, size_t a_len,
+                          const char *b, size_t b_len) {
+  size_t a_head = a_len < 8 ? a_len : 8, b_head = b_len < 8 ? b_len : 8;
+  uint64_t va = read_uint64(a, a_head), vb = read_uint64(b, b_head);
+  if (va != vb) {
+    return va < vb ? -1 : 1;
+  }
+  if (a_head != b_head) {
+    return a_head < b_head ? -1 : 1;
+  }
+  return compare_bytes(a + a_head, a_len - a_head, b + b_head, b_len - b_head);
+}
+
+static uint64_t read_uint64(const char *x, size_t len) {
+  uint64_t ret = 0;
+  for (size_t i = 0; i < len; ++i) {
+    ret = (ret << 8) | (unsigned char) x[i];
+  }
+  return ret;
+}
+
+static int comparator_state_compare(void *state,
+                                    const char *a, size_t a_len,
+                                    const char *b, size_t b_len) {
+  return ((rleveldb_comparator*) state)->compare(a, a_len, b, b_len);
+}
+
+static const char* comparator_state_name(void *state) {
+  return ((rleveldb_comparator*) state)->leveldb_name;
+}
+
+// The state is static, so there is nothing to free
+static void comparator_state_destroy(void *state) {
+}
@@ -0,0 +1,52 @@
+#ifndef RLEVELDB_COMPARATOR_H
+#define RLEVELDB_COMPARATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <leveldb/c.h>
+
+// Native key orderings that a database can be opened with in place
+// of leveldb's default bytewise ordering:
+//
+//   bytewise: leveldb's own ordering
+//   reverse:  bytewise, reversed, so that iterating forward over keys
+//             that increase with time gives the latest first
+//   natural:  runs of digits compare by their numeric value, so "a2"
+//             sorts before "a10" (keys that differ only in leading
+//             zeros are ordered bytewise)
+//   uint64:   the first 8 bytes of the key (all of it if shorter)
+//             compare as a big-endian unsigned integer, then shorter
+//             such heads first, then any remaining bytes bytewise
+//
+// leveldb records the name of the comparator in the database and
+// refuses to open it with a comparator of any other name, so these
+// names must never change.  The comparators are created once, when
+// the package is loaded, and live until it is unloaded, as leveldb
+// keeps using them until the last database using them is closed.
+// Comparisons do not use the R API (they run on leveldb's threads).
+typedef enum comparator_type {
+  COMPARATOR_BYTEWISE,
+  COMPARATOR_REVERSE,
+  COMPARATOR_NATURAL,
+  COMPARATOR_UINT64,
+  COMPARATOR_COUNT // don't store anything here!
+} comparator_type;
+
+typedef struct rleveldb_comparator rleveldb_comparator;
+
+void comparator_init();
+void comparator_cleanup();
+
+const rleveldb_comparator* comparator_find(const char *name);
+const rleveldb_comparator* comparator_get(comparator_type type);
+comparator_type comparator_type_of(const rleveldb_comparator *comparator);
+const char* comparator_name(const rleveldb_comparator *comparator);
+leveldb_comparator_t* comparator_leveldb(
+  const rleveldb_comparator *comparator);
+
+// A NULL comparator is the same as the bytewise one
+bool comparator_is_bytewise(const rleveldb_comparator *comparator);
+int comparator_compare(const rleveldb_comparator *comparator,
+                       const char *a, size_t a_len,
+                       const char *b, size_t b_len);
+#endif
@@ -0,0 +1,268 @@
+#include "encode.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "support.h"
+
+// Order-preserving binary encoding of keys, so that numeric and
+// composite keys sort correctly under leveldb's bytewise ordering.
+// Each component of a key is encoded, without any type tag, as:
+//
+//   integer:   4 bytes, big endian, with the sign bit flipped
+//   double:    8 bytes, big endian IEEE 754; for non-negative numbers
+//              the sign bit is flipped and for negative numbers all
+//              bits are flipped
+//   character: the UTF-8 bytes followed by a single nul byte
+//
+// A key is the concatenation of its components, so keys compare
+// component by component.  R strings can't contain nul bytes, so the
+// terminator keeps shorter strings sorting first (which a length
+// prefix would not) and means that encoding a leading subset of the
+// components gives a prefix that matches exactly those keys.
+typedef enum key_type {
+  KEY_INTEGER,
+  KEY_DOUBLE,
+  KEY_CHARACTER
+} key_type;
+
+static key_type to_key_type(SEXP x);
+static key_type to_key_type_name(const char *name);
+static void encode_uint32(uint32_t x, unsigned char *dest);
+static void encode_uint64(uint64_t x, unsigned char *dest);
+static uint32_t decode_uint32(const unsigned char *src);
+static uint64_t decode_uint64(const unsigned char *src);
+
+SEXP rleveldb_key_encode(SEXP r_components) {
+  if (TYPEOF(r_components) != VECSXP || LENGTH(r_components) == 0) {
+    Rf_error("Expected at least one key component");
+  }
+  size_t n_components = LENGTH(r_components);
+  key_type *types = (key_type*) R_alloc(n_components, sizeof(key_type));
+  size_t n = 0;
+  for (size_t j = 0; j < n_components; ++j) {
+    SEXP el = VECTOR_ELT(r_components, j);
+    types[j] = to_key_type(el);
+    size_t len = XLENGTH(el);
+    if (len == 0) {
+      n = 0;
+      break;
+    } else if (len > n) {
+      n = len;
+    }
+  }
+  for (size_t j = 0; j < n_components && n > 0; ++j) {
+    size_t len = XLENGTH(VECTOR_ELT(r_components, j));
+    if (len != 1 && len != n) {
+      Rf_error("Key components must have length 1 or %d", (int) n);
+    }
+  }
+
+  // First pass: validate and compute the total size
+  size_t total = 0;
+  for (size_t j = 0; j < n_components && n > 0; ++j) {
+    SEXP el = VECTOR_ELT(r_components, j);
+    size_t len = XLENGTH(el);
+    switch (types[j]) {
+    case KEY_INTEGER:
+      for (size_t i = 0; i < len; ++i) {
+        if (INTEGER(el)[i] == NA_INTEGER) {
+          Rf_error("Key components may not be missing");
+        }
+      }
+      total += 4 * n;
+      break;
+    case KEY_DOUBLE:
+      for (size_t i = 0; i < len; ++i) {
+        if (ISNAN(REAL(el)[i])) {
+          Rf_error("Key components may not be missing");
+        }
+      }
+      total += 8 * n;
+      break;
+    case KEY_CHARACTER:
+      for (size_t i = 0; i < n; ++i) {
+        SEXP s = STRING_ELT(el, len == 1 ? 0 : i);
+        if (s == NA_STRING) {
+          Rf_error("Key components may not be missing");
+        }
+        total += strlen(translateCharUTF8(s)) + 1;
+      }
+      break;
+    }
+  }
+
+  SEXP ret = PROTECT(allocVector(VECSXP, 2));
+  SEXP r_data = PROTECT(allocVector(RAWSXP, total));
+  SEXP r_offset = PROTECT(allocVector(REALSXP, n + 1));
+  SET_VECTOR_ELT(ret, 0, r_data);
+  SET_VECTOR_ELT(ret, 1, r_offset);
+  unsigned char *data = RAW(r_data);
+  double *offset = REAL(r_offset);
+
+  size_t at = 0;
+  offset[0] = 0;
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n_components; ++j) {
+      SEXP el = VECTOR_ELT(r_components, j);
+      size_t k = XLENGTH(el) == 1 ? 0 : i;
+      switch (types[j]) {
+      case KEY_INTEGER:
+        encode_uint32((uint32_t) INTEGER(el)[k] ^ 0x80000000u, data + at);
+        at += 4;
+        break;
+      case KEY_DOUBLE: {
+        double x = REAL(el)[k];
+        if (x == 0) {
+          x = 0; // treat -0 as 0
+        }
+        uint64_t bits;
+        memcpy(&bits, &x, sizeof(double));
+        bits = (bits >> 63) ? ~bits : bits ^ ((uint64_t) 1 << 63);
+        encode_uint64(bits, data + at);
+        at += 8;
+        break;
+      }
+      case KEY_CHARACTER: {
+        const char *s = translateCharUTF8(STRING_ELT(el, k));
+        size_t len = strlen(s) + 1;
+        memcpy(data + at, s, len);
+        at += len;
+        break;
+      }
+      }
+    }
+    offset[i + 1] = at;
+  }
+
+  SEXP nms = PROTECT(allocVector(STRSXP, 2));
+  SET_STRING_ELT(nms, 0, mkChar("data"));
+  SET_STRING_ELT(nms, 1, mkChar("offset"));
+  setAttrib(ret, R_NamesSymbol, nms);
+  setAttrib(ret, R_ClassSymbol, mkString("leveldb_packed"));
+  UNPROTECT(4);
+  return ret;
+}
+
+// Decode keys (packed, a list of raw vectors, or a single raw vector)
+// into a list with one vector per component.
+SEXP rleveldb_key_decode(SEXP r_x, SEXP r_types) {
+  if (TYPEOF(r_types) != STRSXP || LENGTH(r_types) == 0) {
+    Rf_error("Expected a character vector of key types");
+  }
+  size_t n_components = LENGTH(r_types);
+  key_type *types = (key_type*) R_alloc(n_components, sizeof(key_type));
+  for (size_t j = 0; j < n_components; ++j) {
+    types[j] = to_key_type_name(CHAR(STRING_ELT(r_types, j)));
+  }
+
+  const char **key_data = NULL;
+  size_t *key_len = NULL;
+  size_t n = get_keys(r_x, &key_data, &key_len);
+
+  SEXP ret = PROTECT(allocVector(VECSXP, n_components));
+  for (size_t j = 0; j < n_components; ++j) {
+    SEXPTYPE type = types[j] == KEY_INTEGER ? INTSXP :
+      (types[j] == KEY_DOUBLE ? REALSXP : STRSXP);
+    SET_VECTOR_ELT(ret, j, allocVector(type, n));
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    const unsigned char *data = (const unsigned char*) key_data[i];
+    size_t len = key_len[i], at = 0;
+    for (size_t j = 0; j < n_components; ++j) {
+      SEXP el = VECTOR_ELT(ret, j);
+      switch (types[j]) {
+      case KEY_INTEGER:
+        if (len - at < 4) {
+          Rf_error("Key %d is too short to decode", (int) i + 1);
+        }
+        INTEGER(el)[i] = (int) (decode_uint32(data + at) ^ 0x80000000u);
+        at += 4;
+        break;
+      case KEY_DOUBLE: {
+        if (len - at < 8) {
+          Rf_error("Key %d is too short to decode", (int) i + 1);
+        }
+        uint64_t bits = decode_uint64(data + at);
+        bits = (bits >> 63) ? bits ^ ((uint64_t) 1 << 63) : ~bits;
+        memcpy(REAL(el) + i, &bits, sizeof(double));
+        at += 8;
+        break;
+      }
+      case KEY_CHARACTER: {
+        const unsigned char *end = memchr(data + at, '\0', len - at);
+        if (end == NULL) {
+          Rf_error("Key %d has an unterminated string", (int) i + 1);
+        }
+        size_t str_len = end - (data + at);
+        SET_STRING_ELT(el, i, mkCharLenCE((const char*) data + at, str_len,
+                                          CE_UTF8));
+        at += str_len + 1;
+        break;
+      }
+      }
+    }
+    if (at != len) {
+      Rf_error("Key %d has %d trailing bytes", (int) i + 1, (int) (len - at));
+    }
+  }
+
+  setAttrib(ret, R_NamesSymbol, getAttrib(r_types, R_NamesSymbol));
+  UNPROTECT(1);
+  return ret;
+}
+
+static key_type to_key_type(SEXP x) {
+  switch (TYPEOF(x)) {
+  case INTSXP:
+    if (OBJECT(x)) {
+      Rf_error("Factors and other classed integers can't be used as keys");
+    }
+    return KEY_INTEGER;
+  case REALSXP:
+    return KEY_DOUBLE;
+  case STRSXP:
+    return KEY_CHARACTER;
+  default:
+    Rf_error("Key components must be integer, double or character vectors");
+  }
+}
+
+static key_type to_key_type_name(const char *name) {
+  if (strcmp(name, "integer") == 0) {
+    return KEY_INTEGER;
+  } else if (strcmp(name, "double") == 0) {
+    return KEY_DOUBLE;
+  } else if (strcmp(name, "character") == 0) {
+    return KEY_CHARACTER;
+  } else {
+    Rf_error("Unknown key type '%s'", name);
+  }
+}
+
+static void encode_uint32(uint32_t x, unsigned char *dest) {
+  for (int i = 3; i >= 0; --i, x >>= 8) {
+    dest[i] = x & 0xff;
+  }
+}
+
+static void encode_uint64(uint64_t x, unsigned char *dest) {
+  for (int i = 7; i >= 0; --i, x >>= 8) {
+    dest[i] = x & 0xff;
+  }
+}
+
+static uint32_t decode_uint32(const unsigned char *src) {
+  uint32_t x = 0;
+  for (int i = 0; i < 4; ++i) {
+    x = (x << 8) | src[i];
+  }
+  return x;
+}
+
+static uint64_t decode_uint64(const unsigned char *src) {
+  uint64_t x = 0;
+  for (int i = 0; i < 8; ++i) {
+    x = (x << 8) | src[i];
+  }
+  return x;
+}
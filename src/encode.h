@@ -0,0 +1,9 @@
+#ifndef RLEVELDB_ENCODE_H
+#define RLEVELDB_ENCODE_H
+
+#include <R.h>
+#include <Rinternals.h>
+
+SEXP rleveldb_key_encode(SEXP r_components);
+SEXP rleveldb_key_decode(SEXP r_x, SEXP r_types);
+#endif
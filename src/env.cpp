@@ -0,0 +1,295 @@
+#include "env.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <leveldb/db.h>
+#include <leveldb/env.h>
+
+// leveldb builds NewMemEnv (from helpers/memenv) into the library, or
+// into libmemenv, but does not install its header.  configure defines
+// RLEVELDB_NO_MEMENV if it can't be linked from either.
+#ifndef RLEVELDB_NO_MEMENV
+namespace leveldb {
+Env* NewMemEnv(Env* base_env);
+}
+#endif
+
+// The C API's handle for an Env, as defined in leveldb's c.cc (which
+// is not public).  leveldb_options_set_env only reads 'rep', so an
+// Env of our own can be passed through it in one of these.  The C API
+// offers no other way to do that, so this is limited to the releases
+// that it has been checked against (as is configure).
+static_assert(leveldb::kMajorVersion == 1 &&
+              leveldb::kMinorVersion >= 18 && leveldb::kMinorVersion <= 23,
+              "leveldb_env_t has only been checked for leveldb 1.18-1.23");
+struct leveldb_env_t {
+  leveldb::Env* rep;
+  bool is_default;
+};
+
+namespace {
+
+typedef std::chrono::steady_clock env_clock;
+
+class CountingEnv : public leveldb::EnvWrapper {
+public:
+  CountingEnv(leveldb::Env *base, bool owns_base, double rate_limit)
+    : leveldb::EnvWrapper(base), owns_base_(owns_base),
+      rate_limit_(rate_limit), next_write_(env_clock::now()) {
+    reset();
+  }
+  ~CountingEnv() {
+    if (owns_base_) {
+      delete target();
+    }
+  }
+
+  leveldb::Status NewSequentialFile(const std::string& fname,
+                                    leveldb::SequentialFile** result)
+    override;
+  leveldb::Status NewRandomAccessFile(const std::string& fname,
+                                      leveldb::RandomAccessFile** result)
+    override;
+  leveldb::Status NewWritableFile(const std::string& fname,
+                                  leveldb::WritableFile** result) override;
+  leveldb::Status NewAppendableFile(const std::string& fname,
+                                    leveldb::WritableFile** result)
+    override;
+
+  void read(size_t n) {
+    ++reads_;
+    bytes_read_ += n;
+  }
+  void write(size_t n) {
+    throttle(n);
+    ++writes_;
+    bytes_written_ += n;
+  }
+
+  void get_stats(bool reset_stats, env_stats *stats) {
+    stats->files_opened = files_opened_;
+    stats->reads = reads_;
+    stats->bytes_read = bytes_read_;
+    stats->writes = writes_;
+    stats->bytes_written = bytes_written_;
+    stats->throttled = throttled_us_ / 1e6;
+    if (reset_stats) {
+      reset();
+    }
+  }
+
+private:
+  void reset() {
+    files_opened_ = 0;
+    reads_ = 0;
+    bytes_read_ = 0;
+    writes_ = 0;
+    bytes_written_ = 0;
+    throttled_us_ = 0;
+  }
+
+  // Each write reserves the next n / rate_limit seconds of the budget
+  // and waits until its reservation starts, so that writes from all
+  // threads together stay under the limit.
+  void throttle(size_t n) {
+    if (rate_limit_ <= 0) {
+      return;
+    }
+    env_clock::time_point now = env_clock::now(), start;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (next_write_ < now) {
+        next_write_ = now;
+      }
+      start = next_write_;
+      next_write_ += std::chrono::duration_cast<env_clock::duration>(
+        std::chrono::duration<double>(n / rate_limit_));
+    }
+    if (start > now) {
+      std::this_thread::sleep_until(start);
+      throttled_us_ +=
+        std::chrono::duration_cast<std::chrono::microseconds>(start - now)
+        .count();
+    }
+  }
+
+  bool owns_base_;
+  double rate_limit_;
+  std::mutex mutex_;
+  env_clock::time_point next_write_;
+  std::atomic<uint64_t> files_opened_;
+  std::atomic<uint64_t> reads_;
+  std::atomic<uint64_t> bytes_read_;
+  std::atomic<uint64_t> writes_;
+  std::atomic<uint64_t> bytes_written_;
+  std::atomic<uint64_t> throttled_us_;
+};
+
+class CountingSequentialFile : public leveldb::SequentialFile {
+public:
+  CountingSequentialFile(leveldb::SequentialFile *file, CountingEnv *env)
+    : file_(file), env_(env) {}
+  ~CountingSequentialFile() {
+    delete file_;
+  }
+  leveldb::Status Read(size_t n, leveldb::Slice* result, char* scratch)
+    override {
+    leveldb::Status s = file_->Read(n, result, scratch);
+    env_->read(result->size());
+    return s;
+  }
+  leveldb::Status Skip(uint64_t n) override {
+    return file_->Skip(n);
+  }
+private:
+  leveldb::SequentialFile *file_;
+  CountingEnv *env_;
+};
+
+class CountingRandomAccessFile : public leveldb::RandomAccessFile {
+public:
+  CountingRandomAccessFile(leveldb::RandomAccessFile *file, CountingEnv *env)
+    : file_(file), env_(env) {}
+  ~CountingRandomAccessFile() {
+    delete file_;
+  }
+  leveldb::Status Read(uint64_t offset, size_t n, leveldb::Slice* result,
+                       char* scratch) const override {
+    leveldb::Status s = file_->Read(offset, n, result, scratch);
+    env_->read(result->size());
+    return s;
+  }
+private:
+  leveldb::RandomAccessFile *file_;
+  CountingEnv *env_;
+};
+
+class CountingWritableFile : public leveldb::WritableFile {
+public:
+  CountingWritableFile(leveldb::WritableFile *file, CountingEnv *env)
+    : file_(file), env_(env) {}
+  ~CountingWritableFile() {
+    delete file_;
+  }
+  leveldb::Status Append(const leveldb::Slice& data) override {
+    env_->write(data.size());
+    return file_->Append(data);
+  }
+  leveldb::Status Close() override {
+    return file_->Close();
+  }
+  leveldb::Status Flush() override {
+    return file_->Flush();
+  }
+  leveldb::Status Sync() override {
+    return file_->Sync();
+  }
+private:
+  leveldb::WritableFile *file_;
+  CountingEnv *env_;
+};
+
+leveldb::Status CountingEnv::NewSequentialFile(
+  const std::string& fname, leveldb::SequentialFile** result) {
+  leveldb::Status s = target()->NewSequentialFile(fname, result);
+  if (s.ok()) {
+    ++files_opened_;
+    *result = new CountingSequentialFile(*result, this);
+  }
+  return s;
+}
+
+leveldb::Status CountingEnv::NewRandomAccessFile(
+  const std::string& fname, leveldb::RandomAccessFile** result) {
+  leveldb::Status s = target()->NewRandomAccessFile(fname, result);
+  if (s.ok()) {
+    ++files_opened_;
+    *result = new CountingRandomAccessFile(*result, this);
+  }
+  return s;
+}
+
+leveldb::Status CountingEnv::NewWritableFile(
+  const std::string& fname, leveldb::WritableFile** result) {
+  leveldb::Status s = target()->NewWritableFile(fname, result);
+  if (s.ok()) {
+    ++files_opened_;
+    *result = new CountingWritableFile(*result, this);
+  }
+  return s;
+}
+
+leveldb::Status CountingEnv::NewAppendableFile(
+  const std::string& fname, leveldb::WritableFile** result) {
+  leveldb::Status s = target()->NewAppendableFile(fname, result);
+  if (s.ok()) {
+    ++files_opened_;
+    *result = new CountingWritableFile(*result, this);
+  }
+  return s;
+}
+
+}
+
+struct rleveldb_env {
+  CountingEnv *env;
+  leveldb_env_t handle;
+};
+
+static leveldb::Env* new_mem_env() {
+#ifdef RLEVELDB_NO_MEMENV
+  return NULL;
+#else
+  return leveldb::NewMemEnv(leveldb::Env::Default());
+#endif
+}
+
+bool env_memory_available() {
+#ifdef RLEVELDB_NO_MEMENV
+  return false;
+#else
+  return true;
+#endif
+}
+
+// NULL on failure; nothing here may throw into C.
+rleveldb_env* env_create(bool memory, double rate_limit) {
+  if (memory && !env_memory_available()) {
+    return NULL;
+  }
+  rleveldb_env *ret = new (std::nothrow) rleveldb_env;
+  if (ret == NULL) {
+    return NULL;
+  }
+  leveldb::Env *base = NULL;
+  try {
+    base = memory ? new_mem_env() : leveldb::Env::Default();
+    ret->env = new CountingEnv(base, memory, rate_limit);
+  } catch (...) {
+    if (memory) {
+      delete base;
+    }
+    delete ret;
+    return NULL;
+  }
+  ret->handle.rep = ret->env;
+  ret->handle.is_default = false;
+  return ret;
+}
+
+void env_destroy(void *env) {
+  rleveldb_env *obj = static_cast<rleveldb_env*>(env);
+  delete obj->env;
+  delete obj;
+}
+
+leveldb_env_t* env_leveldb(rleveldb_env *env) {
+  return &env->handle;
+}
+
+void env_get_stats(rleveldb_env *env, bool reset, env_stats *stats) {
+  env->env->get_stats(reset, stats);
+}
@@ -0,0 +1,41 @@
+#ifndef RLEVELDB_ENV_H
+#define RLEVELDB_ENV_H
+
+#include <stdbool.h>
+#include <leveldb/c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An Env (leveldb's interface to the filesystem and background
+// threads) for a database to be opened with.  It is either the
+// default, on-disk, Env or one held entirely in memory (leveldb's
+// NewMemEnv, where files last as long as the Env does), wrapped so
+// that file I/O is counted and, if rate_limit is positive, writes are
+// throttled to that many bytes per second.  The C API can only make
+// the default Env, so this part is C++.  The memory Env is missing
+// from some leveldb builds (see env_memory_available).
+typedef struct rleveldb_env rleveldb_env;
+
+typedef struct env_stats {
+  double files_opened;
+  double reads;
+  double bytes_read;
+  double writes;
+  double bytes_written;
+  double throttled; // seconds spent waiting for the rate limit
+} env_stats;
+
+#define ENV_STATS_LENGTH 6
+
+bool env_memory_available(void);
+rleveldb_env* env_create(bool memory, double rate_limit);
+void env_destroy(void *env);
+leveldb_env_t* env_leveldb(rleveldb_env *env);
+void env_get_stats(rleveldb_env *env, bool reset, env_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,273 @@
+#include "filter.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <regex.h>
+#endif
+#include "support.h"
+
+// Keys shorter than this are nul-terminated on the stack for regexec
+#define FILTER_KEY_BUFFER 256
+
+struct rleveldb_filter {
+  char *key_glob;
+  size_t key_glob_len;
+  bool has_key_regex;
+#ifndef _WIN32
+  regex_t key_regex;
+#endif
+  char *value_contains;
+  size_t value_contains_len;
+  char *value_starts_with;
+  size_t value_starts_with_len;
+  size_t key_min_length;
+  size_t key_max_length;
+};
+
+static void rleveldb_filter_finalize(SEXP r_filter);
+static char* filter_copy(SEXP r_x, const char *name, size_t *len);
+static bool key_regex_match(const rleveldb_filter *filter,
+                            const char *key, size_t key_len);
+static bool bytes_contains(const char *x, size_t x_len,
+                           const char *pattern, size_t pattern_len);
+
+SEXP rleveldb_filter_create(SEXP r_key_glob, SEXP r_key_regex,
+                            SEXP r_value_contains, SEXP r_value_starts_with,
+                            SEXP r_key_min_length, SEXP r_key_max_length) {
+  // The filter is owned by the external pointer from the outset, so
+  // that nothing leaks if an argument turns out to be invalid.
+  rleveldb_filter *filter =
+    (rleveldb_filter*) calloc(1, sizeof(rleveldb_filter));
+  if (filter == NULL) {
+    Rf_error("Could not allocate filter");
+  }
+  SEXP r_filter = PROTECT(R_MakeExternalPtr(filter, R_NilValue, R_NilValue));
+  R_RegisterCFinalizer(r_filter, rleveldb_filter_finalize);
+
+  filter->key_glob = filter_copy(r_key_glob, "key_glob",
+                                 &filter->key_glob_len);
+  filter->value_contains = filter_copy(r_value_contains, "value_contains",
+                                       &filter->value_contains_len);
+  filter->value_starts_with =
+    filter_copy(r_value_starts_with, "value_starts_with",
+                &filter->value_starts_with_len);
+  filter->key_min_length =
+    r_key_min_length == R_NilValue ? 0 : scalar_size(r_key_min_length);
+  filter->key_max_length =
+    r_key_max_length == R_NilValue ? SIZE_MAX : scalar_size(r_key_max_length);
+
+  if (r_key_regex != R_NilValue) {
+    const char *pattern = scalar_character(r_key_regex);
+#ifdef _WIN32
+    (void) pattern;
+    Rf_error("key_regex is not supported on Windows; use key_glob");
+#else
+    int status = regcomp(&filter->key_regex, pattern,
+                         REG_EXTENDED | REG_NOSUB);
+    if (status != 0) {
+      char msg[256];
+      regerror(status, &filter->key_regex, msg, sizeof(msg));
+      Rf_error("Invalid key_regex: %s", msg);
+    }
+    filter->has_key_regex = true;
+#endif
+  }
+
+  UNPROTECT(1);
+  return r_filter;
+}
+
+// NULL is allowed, and means no filter
+rleveldb_filter* rleveldb_get_filter(SEXP r_filter) {
+  if (r_filter == R_NilValue) {
+    return NULL;
+  }
+  if (TYPEOF(r_filter) != EXTPTRSXP) {
+    Rf_error("Expected a leveldb_filter for 'filter'");
+  }
+  rleveldb_filter *filter = (rleveldb_filter*) R_ExternalPtrAddr(r_filter);
+  if (filter == NULL) {
+    Rf_error("leveldb filter is not valid");
+  }
+  return filter;
+}
+
+// Does the entry under the iterator pass the filter?  Cheap checks on
+// the key come first and the value is only looked at if needed.
+bool filter_match(const rleveldb_filter *filter, leveldb_iterator_t *it) {
+  if (filter == NULL) {
+    return true;
+  }
+  size_t key_len;
+  const char *key = leveldb_iter_key(it, &key_len);
+  if (key_len < filter->key_min_length || key_len > filter->key_max_length) {
+    return false;
+  }
+  if (filter->key_glob != NULL &&
+      !glob_match(filter->key_glob, filter->key_glob_len, key, key_len)) {
+    return false;
+  }
+  if (filter->has_key_regex && !key_regex_match(filter, key, key_len)) {
+    return false;
+  }
+  if (filter->value_contains != NULL || filter->value_starts_with != NULL) {
+    size_t value_len;
+    const char *value = leveldb_iter_value(it, &value_len);
+    if (filter->value_starts_with != NULL &&
+        (value_len < filter->value_starts_with_len ||
+         memcmp(value, filter->value_starts_with,
+                filter->value_starts_with_len) != 0)) {
+      return false;
+    }
+    if (filter->value_contains != NULL &&
+        !bytes_contains(value, value_len, filter->value_contains,
+                        filter->value_contains_len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Shell-style wildcards over bytes: '*' matches any run of bytes, '?'
+// any single byte, '[...]' a set (with ranges like 'a-z' and negation
+// with a leading '!' or '^') and '\' escapes the next byte.  The whole
+// key must match.
+bool glob_match(const char *pattern, size_t pattern_len,
+                const char *str, size_t str_len) {
+  size_t p = 0, s = 0;
+  // Where to resume after the most recent '*', if a match fails
+  size_t star_p = SIZE_MAX, star_s = 0;
+  while (s < str_len) {
+    bool matched = false;
+    size_t next_p = p;
+    if (p < pattern_len) {
+      unsigned char c = (unsigned char) pattern[p];
+      unsigned char x = (unsigned char) str[s];
+      if (c == '*') {
+        star_p = ++p;
+        star_s = s;
+        continue;
+      } else if (c == '?') {
+        matched = true;
+        next_p = p + 1;
+      } else if (c == '[') {
+        size_t q = p + 1;
+        bool negate =
+          q < pattern_len && (pattern[q] == '!' || pattern[q] == '^');
+        if (negate) {
+          ++q;
+        }
+        bool in_set = false, first = true;
+        while (q < pattern_len && (first || pattern[q] != ']')) {
+          unsigned char lo = (unsigned char) pattern[q], hi = lo;
+          if (q + 2 < pattern_len && pattern[q + 1] == '-' &&
+              pattern[q + 2] != ']') {
+            hi = (unsigned char) pattern[q + 2];
+            q += 2;
+          }
+          in_set = in_set || (x >= lo && x <= hi);
+          ++q;
+          first = false;
+        }
+        if (q < pattern_len) {
+          matched = in_set != negate;
+          next_p = q + 1;
+        } else {
+          // Unterminated set: treat '[' literally
+          matched = x == c;
+          next_p = p + 1;
+        }
+      } else {
+        if (c == '\\' && p + 1 < pattern_len) {
+          c = (unsigned char) pattern[++p];
+        }
+        matched = x == c;
+        next_p = p + 1;
+      }
+    }
+    if (matched) {
+      p = next_p;
+      ++s;
+    } else if (star_p != SIZE_MAX) {
+      p = star_p;
+      s = ++star_s;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern_len && pattern[p] == '*') {
+    ++p;
+  }
+  return p == pattern_len;
+}
+
+static void rleveldb_filter_finalize(SEXP r_filter) {
+  rleveldb_filter *filter = (rleveldb_filter*) R_ExternalPtrAddr(r_filter);
+  if (filter != NULL) {
+#ifndef _WIN32
+    if (filter->has_key_regex) {
+      regfree(&filter->key_regex);
+    }
+#endif
+    free(filter->key_glob);
+    free(filter->value_contains);
+    free(filter->value_starts_with);
+    free(filter);
+    R_ClearExternalPtr(r_filter);
+  }
+}
+
+static char* filter_copy(SEXP r_x, const char *name, size_t *len) {
+  const char *data = NULL;
+  *len = get_bound(r_x, &data, name);
+  if (data == NULL) {
+    return NULL;
+  }
+  char *ret = (char*) malloc(*len + 1);
+  if (ret == NULL) {
+    Rf_error("Could not allocate filter");
+  }
+  memcpy(ret, data, *len);
+  ret[*len] = '\0';
+  return ret;
+}
+
+// regexec needs a nul-terminated string, so keys are matched up to
+// their first nul byte.
+static bool key_regex_match(const rleveldb_filter *filter,
+                            const char *key, size_t key_len) {
+#ifdef _WIN32
+  return true;
+#else
+  char buffer[FILTER_KEY_BUFFER];
+  char *str =
+    key_len < FILTER_KEY_BUFFER ? buffer : (char*) malloc(key_len + 1);
+  if (str == NULL) {
+    return false;
+  }
+  memcpy(str, key, key_len);
+  str[key_len] = '\0';
+  bool ret = regexec(&filter->key_regex, str, 0, NULL, 0) == 0;
+  if (str != buffer) {
+    free(str);
+  }
+  return ret;
+#endif
+}
+
+static bool bytes_contains(const char *x, size_t x_len,
+                           const char *pattern, size_t pattern_len) {
+  if (pattern_len == 0) {
+    return true;
+  }
+  for (const char *at = x; (size_t) (at - x) + pattern_len <= x_len; ++at) {
+    at = (const char*) memchr(at, pattern[0], x_len - (at - x));
+    if (at == NULL || (size_t) (at - x) + pattern_len > x_len) {
+      return false;
+    }
+    if (memcmp(at, pattern, pattern_len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
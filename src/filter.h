@@ -0,0 +1,25 @@
+#ifndef RLEVELDB_FILTER_H
+#define RLEVELDB_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <leveldb/c.h>
+
+// A predicate on keys and values that is evaluated inside the
+// iteration loop of keys(), keys_len() and scan() (and friends), so
+// that only matching entries are turned into R objects.  All given
+// conditions must hold.  Matching does not use the R API, so a filter
+// may be shared between worker threads.
+typedef struct rleveldb_filter rleveldb_filter;
+
+SEXP rleveldb_filter_create(SEXP r_key_glob, SEXP r_key_regex,
+                            SEXP r_value_contains, SEXP r_value_starts_with,
+                            SEXP r_key_min_length, SEXP r_key_max_length);
+rleveldb_filter* rleveldb_get_filter(SEXP r_filter);
+
+bool filter_match(const rleveldb_filter *filter, leveldb_iterator_t *it);
+bool glob_match(const char *pattern, size_t pattern_len,
+                const char *str, size_t str_len);
+#endif
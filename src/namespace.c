@@ -0,0 +1,112 @@
+#include "namespace.h"
+#include <string.h>
+#include "support.h"
+#include "stats.h"
+
+static const char* prefixed(const char *prefix, const char *x, size_t len);
+
+SEXP namespace_create(SEXP r_db, SEXP r_name, size_t id) {
+  SEXP r_ns = PROTECT(allocVector(VECSXP, NS_LENGTH));
+  SEXP r_prefix = PROTECT(allocVector(RAWSXP, NAMESPACE_PREFIX_LEN));
+  namespace_prefix(id, (char*) RAW(r_prefix));
+  SET_VECTOR_ELT(r_ns, NS_DB, r_db);
+  SET_VECTOR_ELT(r_ns, NS_NAME, ScalarString(STRING_ELT(r_name, 0)));
+  SET_VECTOR_ELT(r_ns, NS_ID, ScalarInteger((int) id));
+  SET_VECTOR_ELT(r_ns, NS_PREFIX, r_prefix);
+  SET_VECTOR_ELT(r_ns, NS_STATS, stats_create());
+  UNPROTECT(2);
+  return r_ns;
+}
+
+// Returns the connection that the namespace belongs to
+SEXP namespace_check(SEXP r_ns) {
+  if (TYPEOF(r_ns) != VECSXP || LENGTH(r_ns) != NS_LENGTH ||
+      TYPEOF(VECTOR_ELT(r_ns, NS_DB)) != EXTPTRSXP ||
+      TYPEOF(VECTOR_ELT(r_ns, NS_PREFIX)) != RAWSXP ||
+      LENGTH(VECTOR_ELT(r_ns, NS_PREFIX)) != NAMESPACE_PREFIX_LEN) {
+    Rf_error("Expected a leveldb namespace");
+  }
+  return VECTOR_ELT(r_ns, NS_DB);
+}
+
+void namespace_prefix(size_t id, char *prefix) {
+  prefix[0] = NAMESPACE_MARKER;
+  prefix[1] = (char) ((id >> 8) & 0xff);
+  prefix[2] = (char) (id & 0xff);
+}
+
+// The key within namespace 'id' (an R_alloc copy)
+const char* namespace_key(size_t id, const char *key, size_t key_len,
+                          size_t *len) {
+  char prefix[NAMESPACE_PREFIX_LEN];
+  namespace_prefix(id, prefix);
+  *len = NAMESPACE_PREFIX_LEN + key_len;
+  return prefixed(prefix, key, key_len);
+}
+
+// Decode an id stored in the registry; zero if invalid
+size_t namespace_id(const char *data, size_t len) {
+  if (len != 2) {
+    return 0;
+  }
+  return ((size_t) (unsigned char) data[0] << 8) | (unsigned char) data[1];
+}
+
+bool namespace_reserved(const char *key, size_t key_len) {
+  return key_len > 0 && key[0] == NAMESPACE_MARKER;
+}
+
+// Any keys (a string, raw vector, list or packed object) with the
+// namespace prefix added, as a single packed object which can be
+// passed wherever keys are accepted.
+SEXP namespace_keys(SEXP r_ns, SEXP r_key) {
+  const char *prefix = (const char*) RAW(VECTOR_ELT(r_ns, NS_PREFIX));
+  const char **key_data = NULL;
+  size_t *key_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  size_t bytes = 0;
+  for (size_t i = 0; i < num_key; ++i) {
+    bytes += NAMESPACE_PREFIX_LEN + key_len[i];
+  }
+  char *data;
+  double *offset;
+  SEXP ret = PROTECT(packed_alloc(num_key, bytes, &data, &offset));
+  size_t at = 0;
+  for (size_t i = 0; i < num_key; ++i) {
+    offset[i] = at;
+    memcpy(data + at, prefix, NAMESPACE_PREFIX_LEN);
+    memcpy(data + at + NAMESPACE_PREFIX_LEN, key_data[i], key_len[i]);
+    at += NAMESPACE_PREFIX_LEN + key_len[i];
+  }
+  offset[num_key] = at;
+  UNPROTECT(1);
+  return ret;
+}
+
+// Move a range into the namespace: the bounds are prefixed (with the
+// prefix alone as 'starts_with' if none was given, so the range never
+// leaves the namespace) and the prefix is stripped from returned keys.
+void namespace_range(SEXP r_ns, rleveldb_range *range) {
+  const char *prefix = (const char*) RAW(VECTOR_ELT(r_ns, NS_PREFIX));
+  range->starts_with = prefixed(prefix, range->starts_with,
+                                range->starts_with_len);
+  range->starts_with_len += NAMESPACE_PREFIX_LEN;
+  if (range->start != NULL) {
+    range->start = prefixed(prefix, range->start, range->start_len);
+    range->start_len += NAMESPACE_PREFIX_LEN;
+  }
+  if (range->end != NULL) {
+    range->end = prefixed(prefix, range->end, range->end_len);
+    range->end_len += NAMESPACE_PREFIX_LEN;
+  }
+  range->strip = NAMESPACE_PREFIX_LEN;
+}
+
+static const char* prefixed(const char *prefix, const char *x, size_t len) {
+  char *ret = R_alloc(NAMESPACE_PREFIX_LEN + len, 1);
+  memcpy(ret, prefix, NAMESPACE_PREFIX_LEN);
+  if (len > 0) {
+    memcpy(ret + NAMESPACE_PREFIX_LEN, x, len);
+  }
+  return ret;
+}
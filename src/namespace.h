@@ -0,0 +1,50 @@
+#ifndef RLEVELDB_NAMESPACE_H
+#define RLEVELDB_NAMESPACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "range.h"
+
+// A namespace is a named slice of the keyspace of one database, in
+// the manner of a column family.  Its keys are stored behind a short
+// binary prefix: NAMESPACE_MARKER followed by the namespace's id as a
+// big-endian 16 bit integer.  The registry that maps names to ids is
+// itself stored under id 0, with the name as the rest of the key and
+// the id (2 bytes) as the value.
+//
+// The registry entry with an empty name (and id 0) marks a database
+// as using namespaces.  Once it exists every key that starts with
+// NAMESPACE_MARKER is reserved: writes of such keys outside of a
+// namespace are refused, and ranges outside of a namespace skip over
+// them (see range_valid), so that plain keys() and scan() never
+// return namespaced keys and delete_range() can't remove them.  A
+// database that never uses namespaces is free to use any key.
+#define NAMESPACE_MARKER 0
+#define NAMESPACE_PREFIX_LEN 3
+#define NAMESPACE_MAX_ID 65535
+
+// Elements of the R object for a namespace handle: a list that is
+// cached in the connection's tag, so that there is one handle per
+// name and its counters last as long as the connection.
+enum namespace_index {
+  NS_DB,
+  NS_NAME,
+  NS_ID,
+  NS_PREFIX,
+  NS_STATS,
+  NS_LENGTH // don't store anything here!
+};
+
+SEXP namespace_create(SEXP r_db, SEXP r_name, size_t id);
+SEXP namespace_check(SEXP r_ns);
+
+void namespace_prefix(size_t id, char *prefix);
+const char* namespace_key(size_t id, const char *key, size_t key_len,
+                          size_t *len);
+size_t namespace_id(const char *data, size_t len);
+bool namespace_reserved(const char *key, size_t key_len);
+SEXP namespace_keys(SEXP r_ns, SEXP r_key);
+void namespace_range(SEXP r_ns, rleveldb_range *range);
+#endif
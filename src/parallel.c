@@ -0,0 +1,68 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct parallel_block {
+  parallel_fn fn;
+  void *data;
+  size_t from;
+  size_t to;
+} parallel_block;
+
+static void* parallel_run_block(void *data) {
+  parallel_block *block = (parallel_block*) data;
+  block->fn(block->data, block->from, block->to);
+  return NULL;
+}
+
+// NOTE: this does not use R_alloc because it is also used to
+// allocate on behalf of the worker threads, and nothing in here may
+// throw.
+void parallel_for(size_t n, size_t nthreads, parallel_fn fn, void *data) {
+  if (nthreads > n) {
+    nthreads = n;
+  }
+  if (nthreads <= 1) {
+    if (n > 0) {
+      fn(data, 0, n);
+    }
+    return;
+  }
+  parallel_block *blocks =
+    (parallel_block*) malloc(nthreads * sizeof(parallel_block));
+  pthread_t *threads = (pthread_t*) malloc(nthreads * sizeof(pthread_t));
+  bool *started = (bool*) calloc(nthreads, sizeof(bool));
+  if (blocks == NULL || threads == NULL || started == NULL) {
+    // Out of memory; do the work on this thread instead.
+    free(blocks);
+    free(threads);
+    free(started);
+    fn(data, 0, n);
+    return;
+  }
+  size_t size = n / nthreads, extra = n % nthreads;
+  for (size_t i = 0, from = 0; i < nthreads; ++i) {
+    size_t to = from + size + (i < extra ? 1 : 0);
+    blocks[i].fn = fn;
+    blocks[i].data = data;
+    blocks[i].from = from;
+    blocks[i].to = to;
+    from = to;
+  }
+  for (size_t i = 0; i < nthreads - 1; ++i) {
+    started[i] = pthread_create(threads + i, NULL, parallel_run_block,
+                                blocks + i) == 0;
+  }
+  // If a thread could not be started, its block is run here instead.
+  parallel_run_block(blocks + nthreads - 1);
+  for (size_t i = 0; i < nthreads - 1; ++i) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      parallel_run_block(blocks + i);
+    }
+  }
+  free(blocks);
+  free(threads);
+  free(started);
+}
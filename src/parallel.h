@@ -0,0 +1,12 @@
+#ifndef RLEVELDB_PARALLEL_H
+#define RLEVELDB_PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Run fn(data, from, to) over [0, n) split into (up to) nthreads
+// contiguous blocks, each on its own native thread; the last block
+// runs on the calling thread.  fn must not touch the R API.
+typedef void (*parallel_fn)(void *data, size_t from, size_t to);
+void parallel_for(size_t n, size_t nthreads, parallel_fn fn, void *data);
+#endif
@@ -0,0 +1,199 @@
+#include "partition.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <R.h>
+
+// Candidate split keys per part; more candidates give a more even
+// split at the cost of a larger approximate_sizes query.
+#define PARTITION_OVERSAMPLE 16
+
+static bool range_endpoints(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                            const rleveldb_range *range,
+                            char **first, size_t *first_len,
+                            char **last, size_t *last_len);
+static char* malloc_key(leveldb_iterator_t *it, size_t *len);
+static uint64_t key_prefix64(const char *key, size_t len, size_t from);
+
+size_t partition_range(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                       const rleveldb_range *range, size_t n,
+                       rleveldb_range *parts) {
+  if (!comparator_is_bytewise(range->comparator)) {
+    if (n == 0) {
+      return 0;
+    }
+    parts[0] = *range;
+    return 1;
+  }
+  const char **bounds;
+  size_t *bounds_len;
+  size_t k = n == 0 ? 0 :
+    partition_keys(db, readoptions, range, n * PARTITION_OVERSAMPLE,
+                   &bounds, &bounds_len);
+  if (k == 0) {
+    return 0;
+  }
+  parts[0] = *range;
+  if (n == 1 || k == 1) {
+    return 1;
+  }
+
+  uint64_t *sizes = (uint64_t*) R_alloc(k, sizeof(uint64_t));
+  leveldb_approximate_sizes(db, k, bounds, bounds_len,
+                            bounds + 1, bounds_len + 1, sizes);
+  double total = 0;
+  for (size_t i = 0; i < k; ++i) {
+    total += sizes[i];
+  }
+  // Everything may still be in the memtable, in which case there is
+  // nothing to go on but the keys themselves.
+  bool even = total == 0;
+  if (even) {
+    total = k;
+  }
+
+  size_t n_parts = 1;
+  double cumulative = 0, target = total / n;
+  for (size_t i = 0; i + 1 < k && n_parts < n; ++i) {
+    cumulative += even ? 1 : sizes[i];
+    if (cumulative >= target * n_parts) {
+      rleveldb_range *prev = parts + n_parts - 1, *next = parts + n_parts;
+      *next = *range;
+      prev->end = next->start = bounds[i + 1];
+      prev->end_len = next->start_len = bounds_len[i + 1];
+      ++n_parts;
+    }
+  }
+  return n_parts;
+}
+
+// Returns k (at most m) and sets bounds to the k + 1 keys that divide
+// the range into k intervals: bounds[0] is the first key in the range
+// and bounds[k] the last, with increasing split keys in between.
+// These are interpolated between the first and last keys, treating
+// the 8 bytes after their common prefix as a big-endian integer (with
+// trailing zero bytes dropped), so are spaced evenly through the key
+// space rather than by number of keys.  Fewer than m intervals are
+// returned if the first and last keys are too close to split that
+// finely, and none if the range is empty.  Interpolation only makes
+// sense in bytewise order, so under any other comparator this also
+// returns none.
+size_t partition_keys(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                      const rleveldb_range *range, size_t m,
+                      const char ***bounds, size_t **bounds_len) {
+  char *first, *last;
+  size_t first_len, last_len;
+  if (m == 0 || !comparator_is_bytewise(range->comparator) ||
+      !range_endpoints(db, readoptions, range,
+                                 &first, &first_len, &last, &last_len)) {
+    return 0;
+  }
+
+  size_t prefix = 0;
+  while (prefix < first_len && prefix < last_len &&
+         first[prefix] == last[prefix]) {
+    ++prefix;
+  }
+  uint64_t a = key_prefix64(first, first_len, prefix);
+  uint64_t b = key_prefix64(last, last_len, prefix);
+
+  const char **keys = (const char**) R_alloc(m + 1, sizeof(const char*));
+  size_t *keys_len = (size_t*) R_alloc(m + 1, sizeof(size_t));
+  size_t k = 0;
+  keys[0] = first;
+  keys_len[0] = first_len;
+  for (size_t i = 1; i < m && a < b; ++i) {
+    uint64_t v = a + (uint64_t) ((double) (b - a) * i / m);
+    char *key = R_alloc(prefix + 8, 1);
+    memcpy(key, first, prefix);
+    size_t key_len = prefix;
+    for (size_t j = 0; j < 8; ++j) {
+      key[key_len++] = (char) (v >> (56 - 8 * j));
+    }
+    while (key_len > prefix && key[key_len - 1] == 0) {
+      --key_len;
+    }
+    if (compare_bytes(key, key_len, keys[k], keys_len[k]) > 0 &&
+        compare_bytes(key, key_len, last, last_len) < 0) {
+      ++k;
+      keys[k] = key;
+      keys_len[k] = key_len;
+    }
+  }
+  ++k;
+  keys[k] = last;
+  keys_len[k] = last_len;
+  *bounds = keys;
+  *bounds_len = keys_len;
+  return k;
+}
+
+// Find the first and last keys within the range (returned as R_alloc
+// copies); false if the range is empty.
+static bool range_endpoints(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                            const rleveldb_range *range,
+                            char **first, size_t *first_len,
+                            char **last, size_t *last_len) {
+  const char *upper = NULL;
+  size_t upper_len = range_upper(range, &upper);
+
+  // NOTE: leak danger on throw, so nothing between here and the
+  // iter_destroy may throw (keys are copied with malloc until then).
+  leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
+  char *from = NULL, *to = NULL;
+  size_t from_len = 0, to_len = 0;
+  range_seek(it, range);
+  bool nonempty = range_valid(it, range);
+  if (nonempty) {
+    from = malloc_key(it, &from_len);
+    if (upper == NULL) {
+      leveldb_iter_seek_to_last(it);
+    } else {
+      leveldb_iter_seek(it, upper, upper_len);
+      if (leveldb_iter_valid(it)) {
+        leveldb_iter_prev(it);
+      } else {
+        leveldb_iter_seek_to_last(it);
+      }
+    }
+    if (leveldb_iter_valid(it)) {
+      to = malloc_key(it, &to_len);
+    }
+  }
+  leveldb_iter_destroy(it);
+
+  if (nonempty && (from == NULL || to == NULL)) {
+    free(from);
+    free(to);
+    Rf_error("Could not allocate memory for range endpoints");
+  }
+  if (nonempty) {
+    *first = R_alloc(from_len + 1, 1);
+    memcpy(*first, from, from_len);
+    *first_len = from_len;
+    *last = R_alloc(to_len + 1, 1);
+    memcpy(*last, to, to_len);
+    *last_len = to_len;
+  }
+  free(from);
+  free(to);
+  return nonempty;
+}
+
+static char* malloc_key(leveldb_iterator_t *it, size_t *len) {
+  const char *key = leveldb_iter_key(it, len);
+  char *ret = (char*) malloc(*len + 1);
+  if (ret != NULL) {
+    memcpy(ret, key, *len);
+  }
+  return ret;
+}
+
+static uint64_t key_prefix64(const char *key, size_t len, size_t from) {
+  uint64_t ret = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    size_t at = from + i;
+    ret = (ret << 8) | (at < len ? (unsigned char) key[at] : 0);
+  }
+  return ret;
+}
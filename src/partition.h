@@ -0,0 +1,22 @@
+#ifndef RLEVELDB_PARTITION_H
+#define RLEVELDB_PARTITION_H
+
+#include <stddef.h>
+#include <leveldb/c.h>
+#include "range.h"
+
+// Split a range into (up to) n contiguous, non-overlapping parts of
+// roughly equal size on disk, for scanning in parallel.  Candidate
+// split keys are interpolated between the first and last keys in the
+// range and weighted with leveldb_approximate_sizes.  Returns the
+// number of parts written into 'parts' (which must have room for n),
+// which is zero if the range is empty.  Under a comparator other than
+// bytewise the range is not split (see partition_keys).  These use
+// R_alloc, so must be called from the R thread.
+size_t partition_range(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                       const rleveldb_range *range, size_t n,
+                       rleveldb_range *parts);
+size_t partition_keys(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                      const rleveldb_range *range, size_t m,
+                      const char ***bounds, size_t **bounds_len);
+#endif
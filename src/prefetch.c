@@ -0,0 +1,277 @@
+#include "prefetch.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PREFETCH_DATA_MIN 4096
+
+struct rleveldb_prefetch {
+  leveldb_iterator_t *it;
+  rleveldb_range range;
+  char *bounds; // storage for the copied range bounds
+  size_t chunk_size;
+  size_t depth;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t ready; // signalled when a chunk is queued, or when done
+  pthread_cond_t space; // signalled when a chunk is taken off the ring
+
+  // Everything below is protected by the lock, except 'current' which
+  // is only touched by the R thread
+  prefetch_chunk **ring;
+  size_t head;
+  size_t count;
+  bool done;
+  bool stop;
+  bool out_of_memory;
+  char *err;
+  prefetch_chunk *current;
+};
+
+static void* prefetch_thread(void *data);
+static prefetch_chunk* chunk_create(size_t chunk_size);
+static bool chunk_push(char **data, size_t *size, double *offset, size_t n,
+                       const char *x, size_t len);
+static void chunk_destroy(prefetch_chunk *chunk);
+static const char* copy_bound(char **dest, const char *src, size_t len);
+
+rleveldb_prefetch* prefetch_create(leveldb_iterator_t *it,
+                                   const rleveldb_range *range,
+                                   size_t chunk_size, size_t depth) {
+  rleveldb_prefetch *p =
+    (rleveldb_prefetch*) calloc(1, sizeof(rleveldb_prefetch));
+  if (p == NULL) {
+    return NULL;
+  }
+  size_t bounds_len =
+    range->starts_with_len + range->start_len + range->end_len;
+  p->bounds = (char*) malloc(bounds_len > 0 ? bounds_len : 1);
+  p->ring = (prefetch_chunk**) calloc(depth, sizeof(prefetch_chunk*));
+  if (p->bounds == NULL || p->ring == NULL) {
+    free(p->bounds);
+    free(p->ring);
+    free(p);
+    return NULL;
+  }
+  char *dest = p->bounds;
+  p->range = *range;
+  p->range.starts_with =
+    copy_bound(&dest, range->starts_with, range->starts_with_len);
+  p->range.start = copy_bound(&dest, range->start, range->start_len);
+  p->range.end = copy_bound(&dest, range->end, range->end_len);
+  p->it = it;
+  p->chunk_size = chunk_size;
+  p->depth = depth;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->ready, NULL);
+  pthread_cond_init(&p->space, NULL);
+  if (pthread_create(&p->thread, NULL, prefetch_thread, p) != 0) {
+    pthread_cond_destroy(&p->space);
+    pthread_cond_destroy(&p->ready);
+    pthread_mutex_destroy(&p->lock);
+    free(p->bounds);
+    free(p->ring);
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+// Take the next chunk off the ring, waiting up to 'timeout' seconds
+// for one to be ready.  The chunk belongs to the prefetcher and is
+// valid until the next call to prefetch_next or prefetch_close.
+prefetch_state prefetch_next(rleveldb_prefetch *p, double timeout,
+                             const prefetch_chunk **chunk) {
+  chunk_destroy(p->current);
+  p->current = NULL;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  double secs = deadline.tv_nsec / 1e9 + timeout;
+  deadline.tv_sec += (time_t) secs;
+  deadline.tv_nsec = (long) ((secs - (time_t) secs) * 1e9);
+
+  prefetch_state state = PREFETCH_TIMEOUT;
+  pthread_mutex_lock(&p->lock);
+  while (p->count == 0 && !p->done) {
+    if (pthread_cond_timedwait(&p->ready, &p->lock, &deadline) != 0) {
+      break;
+    }
+  }
+  if (p->count > 0) {
+    p->current = p->ring[p->head];
+    p->ring[p->head] = NULL;
+    p->head = (p->head + 1) % p->depth;
+    p->count--;
+    pthread_cond_signal(&p->space);
+    *chunk = p->current;
+    state = PREFETCH_CHUNK;
+  } else if (p->done) {
+    state = PREFETCH_DONE;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return state;
+}
+
+// Stop the thread (abandoning the rest of the range) and free
+// everything, including the iterator; the db must still be open.
+void prefetch_close(rleveldb_prefetch *p) {
+  pthread_mutex_lock(&p->lock);
+  p->stop = true;
+  pthread_cond_signal(&p->space);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->thread, NULL);
+
+  for (size_t i = 0; i < p->depth; ++i) {
+    chunk_destroy(p->ring[i]);
+  }
+  chunk_destroy(p->current);
+  leveldb_iter_destroy(p->it);
+  if (p->err != NULL) {
+    leveldb_free(p->err);
+  }
+  pthread_cond_destroy(&p->space);
+  pthread_cond_destroy(&p->ready);
+  pthread_mutex_destroy(&p->lock);
+  free(p->ring);
+  free(p->bounds);
+  free(p);
+}
+
+// The error that stopped the thread, if any.  Chunks read before the
+// error are still returned; this is only meaningful once
+// prefetch_next has returned PREFETCH_DONE.
+const char* prefetch_error(rleveldb_prefetch *p) {
+  pthread_mutex_lock(&p->lock);
+  const char *err =
+    p->err != NULL ? p->err : (p->out_of_memory ? "out of memory" : NULL);
+  pthread_mutex_unlock(&p->lock);
+  return err;
+}
+
+static void* prefetch_thread(void *data) {
+  rleveldb_prefetch *p = (rleveldb_prefetch*) data;
+  size_t remaining = p->range.limit;
+  bool more = remaining > 0, failed = false;
+  range_seek(p->it, &p->range);
+
+  while (more) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop && p->count == p->depth) {
+      pthread_cond_wait(&p->space, &p->lock);
+    }
+    bool stop = p->stop;
+    pthread_mutex_unlock(&p->lock);
+    if (stop) {
+      break;
+    }
+
+    // The iterator is only ever used by this thread, so the chunk is
+    // filled without holding the lock
+    prefetch_chunk *chunk = chunk_create(p->chunk_size);
+    failed = chunk == NULL;
+    while (!failed && chunk->n < p->chunk_size && remaining > 0 &&
+           range_valid(p->it, &p->range)) {
+      size_t key_len, value_len;
+      const char *key_data = leveldb_iter_key(p->it, &key_len);
+      const char *value_data = leveldb_iter_value(p->it, &value_len);
+      failed =
+        !chunk_push(&chunk->key_data, &chunk->key_size, chunk->key_offset,
+                    chunk->n, key_data, key_len) ||
+        !chunk_push(&chunk->value_data, &chunk->value_size,
+                    chunk->value_offset, chunk->n, value_data, value_len);
+      if (!failed) {
+        chunk->n++;
+        remaining--;
+        leveldb_iter_next(p->it);
+      }
+    }
+    more = !failed && chunk->n == p->chunk_size && remaining > 0 &&
+      range_valid(p->it, &p->range);
+
+    if (chunk != NULL && chunk->n == 0) {
+      chunk_destroy(chunk);
+      chunk = NULL;
+    }
+    if (chunk != NULL) {
+      pthread_mutex_lock(&p->lock);
+      p->ring[(p->head + p->count) % p->depth] = chunk;
+      p->count++;
+      pthread_cond_signal(&p->ready);
+      pthread_mutex_unlock(&p->lock);
+    }
+  }
+
+  char *err = NULL;
+  leveldb_iter_get_error(p->it, &err);
+  pthread_mutex_lock(&p->lock);
+  p->err = err;
+  p->out_of_memory = failed;
+  p->done = true;
+  pthread_cond_broadcast(&p->ready);
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static prefetch_chunk* chunk_create(size_t chunk_size) {
+  prefetch_chunk *chunk = (prefetch_chunk*) calloc(1, sizeof(prefetch_chunk));
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->key_offset = (double*) malloc((chunk_size + 1) * sizeof(double));
+  chunk->value_offset = (double*) malloc((chunk_size + 1) * sizeof(double));
+  if (chunk->key_offset == NULL || chunk->value_offset == NULL) {
+    chunk_destroy(chunk);
+    return NULL;
+  }
+  chunk->key_offset[0] = 0;
+  chunk->value_offset[0] = 0;
+  return chunk;
+}
+
+// Append x as element n, growing the data buffer by doubling
+static bool chunk_push(char **data, size_t *size, double *offset, size_t n,
+                       const char *x, size_t len) {
+  size_t used = (size_t) offset[n];
+  if (used + len > *size) {
+    size_t new_size = *size < PREFETCH_DATA_MIN ? PREFETCH_DATA_MIN : *size;
+    while (used + len > new_size) {
+      new_size *= 2;
+    }
+    char *new_data = (char*) realloc(*data, new_size);
+    if (new_data == NULL) {
+      return false;
+    }
+    *data = new_data;
+    *size = new_size;
+  }
+  if (len > 0) {
+    memcpy(*data + used, x, len);
+  }
+  offset[n + 1] = used + len;
+  return true;
+}
+
+static void chunk_destroy(prefetch_chunk *chunk) {
+  if (chunk != NULL) {
+    free(chunk->key_data);
+    free(chunk->key_offset);
+    free(chunk->value_data);
+    free(chunk->value_offset);
+    free(chunk);
+  }
+}
+
+static const char* copy_bound(char **dest, const char *src, size_t len) {
+  if (src == NULL) {
+    return NULL;
+  }
+  char *ret = *dest;
+  if (len > 0) {
+    memcpy(ret, src, len);
+  }
+  *dest += len;
+  return ret;
+}
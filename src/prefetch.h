@@ -0,0 +1,45 @@
+#ifndef RLEVELDB_PREFETCH_H
+#define RLEVELDB_PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <leveldb/c.h>
+#include "range.h"
+
+// A readahead iterator over a range: a background thread walks an
+// iterator over the range, copying keys and values into chunks of up
+// to chunk_size entries and queueing them in a ring of up to depth
+// chunks, while the R thread takes chunks off the front.  Reading
+// from disk (and decompressing blocks) therefore overlaps with
+// whatever R does with the previous chunk.  None of these functions
+// use the R API.
+typedef struct rleveldb_prefetch rleveldb_prefetch;
+
+// Keys and values are stored back-to-back with n + 1 offsets each, so
+// that a chunk converts directly to a pair of packed objects.
+typedef struct prefetch_chunk {
+  size_t n;
+  char *key_data;
+  double *key_offset;
+  char *value_data;
+  double *value_offset;
+  size_t key_size;    // allocated bytes in key_data
+  size_t value_size;  // allocated bytes in value_data
+} prefetch_chunk;
+
+typedef enum prefetch_state {
+  PREFETCH_CHUNK,   // a chunk was returned
+  PREFETCH_DONE,    // the range is exhausted (or an error occurred)
+  PREFETCH_TIMEOUT  // nothing was ready in time
+} prefetch_state;
+
+// Takes ownership of the iterator, which must not be used elsewhere.
+// The range bounds are copied.
+rleveldb_prefetch* prefetch_create(leveldb_iterator_t *it,
+                                   const rleveldb_range *range,
+                                   size_t chunk_size, size_t depth);
+prefetch_state prefetch_next(rleveldb_prefetch *p, double timeout,
+                             const prefetch_chunk **chunk);
+void prefetch_close(rleveldb_prefetch *p);
+const char* prefetch_error(rleveldb_prefetch *p);
+#endif
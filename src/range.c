@@ -0,0 +1,205 @@
+#include "range.h"
+#include <stdlib.h>
+#include "support.h"
+#include "namespace.h"
+
+static bool needs_buffer(const rleveldb_range *range);
+static size_t lower_bound(const rleveldb_range *range, char *buffer,
+                          const char **lower);
+static size_t prefix_successor(const char *prefix, size_t prefix_len,
+                               char *after);
+static bool skip_reserved(leveldb_iterator_t *it, comparator_type type);
+
+void get_range(SEXP r_starts_with, SEXP r_start, SEXP r_end, SEXP r_limit,
+               const rleveldb_comparator *comparator, rleveldb_range *range) {
+  range->starts_with_len = get_starts_with(r_starts_with, &range->starts_with);
+  range->start_len = get_bound(r_start, &range->start, "start");
+  range->end_len = get_bound(r_end, &range->end, "end");
+  range->limit =
+    r_limit == R_NilValue ? RANGE_NO_LIMIT : scalar_size(r_limit);
+  range->strip = 0;
+  range->comparator = comparator;
+  range->skip_reserved = false;
+}
+
+// Position the iterator at the first key that could be within the
+// range (see range_lower).  Rather than walking the whole database,
+// this means that we only touch the blocks that hold the range.  This
+// may run off the R thread, so any space needed for the bound comes
+// from malloc (if that fails, the bound is just looser).
+void range_seek(leveldb_iterator_t *it, const rleveldb_range *range) {
+  char *buffer = !needs_buffer(range) ? NULL :
+    (char*) malloc(range->starts_with_len);
+  const char *from = NULL;
+  size_t from_len = lower_bound(range, buffer, &from);
+  if (from == NULL) {
+    leveldb_iter_seek_to_first(it);
+  } else {
+    leveldb_iter_seek(it, from, from_len);
+  }
+  free(buffer);
+}
+
+// The smallest key that could be within the range; because keys are
+// sorted, this is the larger of 'start' and 'starts_with' (any key
+// that has the prefix sorts at or after the prefix itself).  In
+// reverse order the keys with the prefix instead start at (or just
+// after) its successor.  Under the other comparators keys with a
+// prefix are not contiguous, so only 'start' bounds the range.  NULL
+// if unbounded.
+size_t range_lower(const rleveldb_range *range, const char **lower) {
+  char *buffer = !needs_buffer(range) ? NULL :
+    R_alloc(range->starts_with_len, 1);
+  return lower_bound(range, buffer, lower);
+}
+
+// An (exclusive) key that every key in the range sorts before: the
+// smaller of 'end' and the first key after all keys that start with
+// 'starts_with'.  Only bytewise order has such a key for a prefix, so
+// otherwise this is just 'end'.  NULL if unbounded.
+size_t range_upper(const rleveldb_range *range, const char **upper) {
+  *upper = range->end;
+  size_t upper_len = range->end_len;
+  if (!comparator_is_bytewise(range->comparator) ||
+      range->starts_with_len == 0) {
+    return upper_len;
+  }
+  char *after = R_alloc(range->starts_with_len, 1);
+  size_t len = prefix_successor(range->starts_with, range->starts_with_len,
+                                after);
+  if (len > 0 &&
+      (*upper == NULL || compare_bytes(after, len, *upper, upper_len) < 0)) {
+    *upper = after;
+    upper_len = len;
+  }
+  return upper_len;
+}
+
+// Is the iterator still within the range?  Once range_seek has been
+// called, the first key that fails the end check is past the end of
+// the range, so iteration can stop there.  In bytewise order so is
+// the first key that fails the prefix check, and in reverse order the
+// first that sorts (bytewise) before the prefix.  Under the other
+// comparators, keys without the prefix are skipped over (advancing
+// the iterator) until the end of the range, so 'starts_with' costs a
+// scan rather than a seek.  Reserved keys are skipped as described at
+// skip_reserved.
+bool range_valid(leveldb_iterator_t *it, const rleveldb_range *range) {
+  comparator_type type = comparator_type_of(range->comparator);
+  while (leveldb_iter_valid(it)) {
+    size_t key_len;
+    const char *key_data = leveldb_iter_key(it, &key_len);
+    if (range->end != NULL &&
+        comparator_compare(range->comparator, key_data, key_len,
+                           range->end, range->end_len) >= 0) {
+      return false;
+    }
+    if (range->skip_reserved && namespace_reserved(key_data, key_len)) {
+      if (!skip_reserved(it, type)) {
+        return false;
+      }
+      continue;
+    }
+    if (range->starts_with_len == 0 ||
+        (key_len >= range->starts_with_len &&
+         memcmp(key_data, range->starts_with, range->starts_with_len) == 0)) {
+      return true;
+    }
+    if (type == COMPARATOR_BYTEWISE ||
+        (type == COMPARATOR_REVERSE &&
+         compare_bytes(key_data, key_len,
+                       range->starts_with, range->starts_with_len) < 0)) {
+      return false;
+    }
+    leveldb_iter_next(it);
+  }
+  return false;
+}
+
+// Same ordering as leveldb's default (bytewise) comparator
+int compare_bytes(const char *a, size_t a_len, const char *b, size_t b_len) {
+  size_t len = a_len < b_len ? a_len : b_len;
+  int ret = len == 0 ? 0 : memcmp(a, b, len);
+  if (ret == 0) {
+    ret = a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+  }
+  return ret;
+}
+
+// Move the iterator off a reserved key; false if no unreserved key
+// can follow.  Reserved keys start with the smallest byte, so in
+// bytewise and natural order they sort before every other key and one
+// seek passes all of them, while in reverse order they sort after
+// every other key.  Under the uint64 comparator they are mixed in with
+// other keys and are stepped over one at a time.
+static bool skip_reserved(leveldb_iterator_t *it, comparator_type type) {
+  const char after[] = {NAMESPACE_MARKER + 1};
+  switch (type) {
+  case COMPARATOR_BYTEWISE:
+  case COMPARATOR_NATURAL:
+    leveldb_iter_seek(it, after, 1);
+    return true;
+  case COMPARATOR_REVERSE:
+    return false;
+  default:
+    leveldb_iter_next(it);
+    return true;
+  }
+}
+
+// Only the reverse order bound on a prefix is a new key
+static bool needs_buffer(const rleveldb_range *range) {
+  return range->starts_with_len > 0 &&
+    comparator_type_of(range->comparator) == COMPARATOR_REVERSE;
+}
+
+// See range_lower; 'buffer' has space for a copy of 'starts_with'
+// (or is NULL).
+static size_t lower_bound(const rleveldb_range *range, char *buffer,
+                          const char **lower) {
+  *lower = range->start;
+  size_t lower_len = range->start_len;
+  const char *from = NULL;
+  size_t from_len = 0;
+  switch (comparator_type_of(range->comparator)) {
+  case COMPARATOR_BYTEWISE:
+    from = range->starts_with;
+    from_len = range->starts_with_len;
+    break;
+  case COMPARATOR_REVERSE:
+    if (buffer != NULL) {
+      from_len = prefix_successor(range->starts_with, range->starts_with_len,
+                                  buffer);
+      from = from_len > 0 ? buffer : NULL;
+    }
+    break;
+  default:
+    break;
+  }
+  if (from_len > 0 &&
+      (*lower == NULL ||
+       comparator_compare(range->comparator, from, from_len,
+                          *lower, lower_len) > 0)) {
+    *lower = from;
+    lower_len = from_len;
+  }
+  return lower_len;
+}
+
+// The first key after all keys that start with the prefix, written
+// into 'after' (which has space for the prefix), found by dropping
+// any trailing 0xff bytes and incrementing the last remaining byte.
+// Returns its length, which is zero if the prefix is empty or all
+// 0xff, in which case there is no such key.
+static size_t prefix_successor(const char *prefix, size_t prefix_len,
+                               char *after) {
+  size_t len = prefix_len;
+  while (len > 0 && (unsigned char) prefix[len - 1] == 0xff) {
+    --len;
+  }
+  if (len > 0) {
+    memcpy(after, prefix, len);
+    after[len - 1] = (char) ((unsigned char) after[len - 1] + 1);
+  }
+  return len;
+}
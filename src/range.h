@@ -0,0 +1,45 @@
+#ifndef RLEVELDB_RANGE_H
+#define RLEVELDB_RANGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <leveldb/c.h>
+#include "comparator.h"
+
+// A contiguous range of keys, as iterated over by keys(), keys_len()
+// and friends.  All bounds are optional; a NULL pointer means the
+// bound is not set.  'start' is inclusive and 'end' is exclusive
+// (following the convention of leveldb's approximate_sizes).  If
+// 'starts_with' is given, only keys with that prefix are included.
+// 'strip' bytes are dropped from the front of keys that are returned
+// (for namespaces, where every key in the range has the same prefix).
+// 'comparator' is the database's ordering (NULL for bytewise), which
+// the bounds are interpreted in; see range_valid for what this means
+// for 'starts_with'.  If 'skip_reserved' is set, keys reserved for
+// namespaces (see namespace.h) are left out of the range.
+typedef struct rleveldb_range {
+  const char *starts_with;
+  size_t starts_with_len;
+  const char *start;
+  size_t start_len;
+  const char *end;
+  size_t end_len;
+  size_t limit;
+  size_t strip;
+  const rleveldb_comparator *comparator;
+  bool skip_reserved;
+} rleveldb_range;
+
+#define RANGE_NO_LIMIT SIZE_MAX
+
+void get_range(SEXP r_starts_with, SEXP r_start, SEXP r_end, SEXP r_limit,
+               const rleveldb_comparator *comparator, rleveldb_range *range);
+void range_seek(leveldb_iterator_t *it, const rleveldb_range *range);
+size_t range_lower(const rleveldb_range *range, const char **lower);
+size_t range_upper(const rleveldb_range *range, const char **upper);
+bool range_valid(leveldb_iterator_t *it, const rleveldb_range *range);
+
+int compare_bytes(const char *a, size_t a_len, const char *b, size_t b_len);
+#endif
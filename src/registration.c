@@ -1,4 +1,8 @@
 #include "rleveldb.h"
+#include "altrep.h"
+#include "encode.h"
+#include "filter.h"
+#include "comparator.h"
 #include <R_ext/Rdynload.h>
 #include <Rversion.h>
 
@@ -10,17 +14,34 @@ SEXP rleveldb_test_cleanup() {
 }
 
 static const R_CallMethodDef call_methods[] = {
-  {"Crleveldb_open",               (DL_FUNC) &rleveldb_open,              10},
+  {"Crleveldb_open",               (DL_FUNC) &rleveldb_open,              12},
   {"Crleveldb_close",              (DL_FUNC) &rleveldb_close,              2},
-  {"Crleveldb_destroy",            (DL_FUNC) &rleveldb_destroy,            1},
-  {"Crleveldb_repair",             (DL_FUNC) &rleveldb_repair,             1},
+  {"Crleveldb_destroy",            (DL_FUNC) &rleveldb_destroy,            2},
+  {"Crleveldb_repair",             (DL_FUNC) &rleveldb_repair,             3},
   {"Crleveldb_property",           (DL_FUNC) &rleveldb_property,           3},
+  {"Crleveldb_stats",              (DL_FUNC) &rleveldb_stats_get,          2},
 
-  {"Crleveldb_get",                (DL_FUNC) &rleveldb_get,                5},
-  {"Crleveldb_mget",               (DL_FUNC) &rleveldb_mget,               6},
+  {"Crleveldb_get",                (DL_FUNC) &rleveldb_get,                6},
+  {"Crleveldb_mget",               (DL_FUNC) &rleveldb_mget,               9},
   {"Crleveldb_put",                (DL_FUNC) &rleveldb_put,                4},
   {"Crleveldb_mput",               (DL_FUNC) &rleveldb_mput,               4},
+  {"Crleveldb_put_object",         (DL_FUNC) &rleveldb_put_object,         5},
+  {"Crleveldb_get_object",         (DL_FUNC) &rleveldb_get_object,         4},
+  {"Crleveldb_mget_object",        (DL_FUNC) &rleveldb_mget_object,        4},
+  {"Crleveldb_mput_object",        (DL_FUNC) &rleveldb_mput_object,        5},
   {"Crleveldb_delete",             (DL_FUNC) &rleveldb_delete,             5},
+  {"Crleveldb_delete_range",       (DL_FUNC) &rleveldb_delete_range,       7},
+  {"Crleveldb_bulk_load",          (DL_FUNC) &rleveldb_bulk_load,          7},
+
+  {"Crleveldb_writer_create",      (DL_FUNC) &rleveldb_writer_create,      5},
+  {"Crleveldb_writer_put",         (DL_FUNC) &rleveldb_writer_put,         3},
+  {"Crleveldb_writer_delete",      (DL_FUNC) &rleveldb_writer_delete,      2},
+  {"Crleveldb_writer_flush",       (DL_FUNC) &rleveldb_writer_flush,       1},
+  {"Crleveldb_writer_close",       (DL_FUNC) &rleveldb_writer_close,       2},
+  {"Crleveldb_writer_status",      (DL_FUNC) &rleveldb_writer_status,      1},
+  {"Crleveldb_prefetch_create",    (DL_FUNC) &rleveldb_prefetch_create,    8},
+  {"Crleveldb_prefetch_next",      (DL_FUNC) &rleveldb_prefetch_next,      2},
+  {"Crleveldb_prefetch_close",     (DL_FUNC) &rleveldb_prefetch_close,     2},
 
   {"Crleveldb_iter_create",        (DL_FUNC) &rleveldb_iter_create,        2},
   {"Crleveldb_iter_destroy",       (DL_FUNC) &rleveldb_iter_destroy,       2},
@@ -32,6 +53,8 @@ static const R_CallMethodDef call_methods[] = {
   {"Crleveldb_iter_prev",          (DL_FUNC) &rleveldb_iter_prev,          2},
   {"Crleveldb_iter_key",           (DL_FUNC) &rleveldb_iter_key,           3},
   {"Crleveldb_iter_value",         (DL_FUNC) &rleveldb_iter_value,         3},
+  {"Crleveldb_iter_next_n",        (DL_FUNC) &rleveldb_iter_next_n,        3},
+  {"Crleveldb_iter_prev_n",        (DL_FUNC) &rleveldb_iter_prev_n,        3},
 
   {"Crleveldb_snapshot_create",    (DL_FUNC) &rleveldb_snapshot_create,    1},
 
@@ -41,22 +64,52 @@ static const R_CallMethodDef call_methods[] = {
   {"Crleveldb_writebatch_put",     (DL_FUNC) &rleveldb_writebatch_put,     3},
   {"Crleveldb_writebatch_mput",    (DL_FUNC) &rleveldb_writebatch_mput,    3},
   {"Crleveldb_writebatch_delete",  (DL_FUNC) &rleveldb_writebatch_delete,  2},
-  {"Crleveldb_write",              (DL_FUNC) &rleveldb_write,              3},
+  {"Crleveldb_writebatch_mdelete", (DL_FUNC) &rleveldb_writebatch_mdelete, 2},
+  {"Crleveldb_write",              (DL_FUNC) &rleveldb_write,              4},
 
   {"Crleveldb_approximate_sizes",  (DL_FUNC) &rleveldb_approximate_sizes,  3},
-  {"Crleveldb_compact_range",      (DL_FUNC) &rleveldb_compact_range,      3},
+  {"Crleveldb_size_histogram",     (DL_FUNC) &rleveldb_size_histogram,     6},
+  {"Crleveldb_compact_range",      (DL_FUNC) &rleveldb_compact_range,      4},
+
+  {"Crleveldb_env_create",         (DL_FUNC) &rleveldb_env_create,         2},
+  {"Crleveldb_env_stats",          (DL_FUNC) &rleveldb_env_stats,          2},
+  {"Crleveldb_cache_create",       (DL_FUNC) &rleveldb_cache_create,       1},
+  {"Crleveldb_bloom_create",       (DL_FUNC) &rleveldb_bloom_create,       1},
 
   {"Crleveldb_readoptions",        (DL_FUNC) &rleveldb_readoptions,        3},
   {"Crleveldb_writeoptions",       (DL_FUNC) &rleveldb_writeoptions,       1},
 
-  {"Crleveldb_keys_len",           (DL_FUNC) &rleveldb_keys_len,           3},
-  {"Crleveldb_keys",               (DL_FUNC) &rleveldb_keys,               4},
+  {"Crleveldb_keys_len",           (DL_FUNC) &rleveldb_keys_len,           7},
+  {"Crleveldb_keys",               (DL_FUNC) &rleveldb_keys,               9},
+  {"Crleveldb_scan",               (DL_FUNC) &rleveldb_scan,               8},
+  {"Crleveldb_parallel_scan",      (DL_FUNC) &rleveldb_parallel_scan,      9},
+  {"Crleveldb_filter_create",      (DL_FUNC) &rleveldb_filter_create,      6},
+  {"Crleveldb_namespace",          (DL_FUNC) &rleveldb_namespace,          3},
+  {"Crleveldb_namespace_list",     (DL_FUNC) &rleveldb_namespace_list,     1},
+  {"Crleveldb_ns_get",             (DL_FUNC) &rleveldb_ns_get,             5},
+  {"Crleveldb_ns_mget",            (DL_FUNC) &rleveldb_ns_mget,            8},
+  {"Crleveldb_ns_put",             (DL_FUNC) &rleveldb_ns_put,             4},
+  {"Crleveldb_ns_mput",            (DL_FUNC) &rleveldb_ns_mput,            4},
+  {"Crleveldb_ns_delete",          (DL_FUNC) &rleveldb_ns_delete,          3},
+  {"Crleveldb_ns_exists",          (DL_FUNC) &rleveldb_ns_exists,          3},
+  {"Crleveldb_ns_keys",            (DL_FUNC) &rleveldb_ns_keys,            7},
+  {"Crleveldb_ns_keys_len",        (DL_FUNC) &rleveldb_ns_keys_len,        6},
+  {"Crleveldb_ns_scan",            (DL_FUNC) &rleveldb_ns_scan,            7},
+  {"Crleveldb_ns_delete_range",    (DL_FUNC) &rleveldb_ns_delete_range,    7},
+  {"Crleveldb_ns_size",            (DL_FUNC) &rleveldb_ns_size,            1},
+  {"Crleveldb_ns_stats",           (DL_FUNC) &rleveldb_ns_stats,           2},
+  {"Crleveldb_unpack",             (DL_FUNC) &rleveldb_unpack,             2},
+  {"Crleveldb_key_encode",         (DL_FUNC) &rleveldb_key_encode,         1},
+  {"Crleveldb_key_decode",         (DL_FUNC) &rleveldb_key_decode,         2},
   {"Crleveldb_exists",             (DL_FUNC) &rleveldb_exists,             3},
   {"Crleveldb_version",            (DL_FUNC) &rleveldb_version,            0},
 
   // For debugging:
   {"Crleveldb_tag",                (DL_FUNC) &rleveldb_tag,                1},
 
+  // For benchmarking:
+  {"Crleveldb_clock",              (DL_FUNC) &rleveldb_clock,              0},
+
   // For testing:
   {"Crleveldb_test_cleanup",       (DL_FUNC) &rleveldb_test_cleanup,       0},
 
@@ -65,6 +118,7 @@ static const R_CallMethodDef call_methods[] = {
 
 void R_init_rleveldb(DllInfo *info) {
   rleveldb_init();
+  rleveldb_altrep_init(info);
   R_registerRoutines(info, NULL, call_methods, NULL, NULL);
 #if defined(R_VERSION) && R_VERSION >= R_Version(3, 3, 0)
   R_useDynamicSymbols(info, FALSE);
@@ -76,5 +130,8 @@ void R_init_rleveldb(DllInfo *info) {
 // # nocov start
 void R_unload_rleveldb(DllInfo *info) {
   rleveldb_cleanup();
+  // Not part of rleveldb_cleanup, as open databases may still be
+  // using the comparators
+  comparator_cleanup();
 }
 // # nocov end
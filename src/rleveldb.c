@@ -1,8 +1,24 @@
 #include "rleveldb.h"
 
+#include <math.h>
 #include <stdbool.h>
 #include <leveldb/c.h>
 #include "support.h"
+#include "range.h"
+#include "parallel.h"
+#include "altrep.h"
+#include "serialize.h"
+#include "stats.h"
+#include "writer.h"
+#include "sort.h"
+#include "prefetch.h"
+#include "partition.h"
+#include "filter.h"
+#include "task.h"
+#include "namespace.h"
+#include "comparator.h"
+#include "env.h"
+#include "shared.h"
 
 leveldb_readoptions_t * default_readoptions;
 leveldb_writeoptions_t * default_writeoptions;
@@ -17,6 +33,13 @@ leveldb_readoptions_t* rleveldb_get_readoptions(SEXP r_readoptions,
 leveldb_writeoptions_t* rleveldb_get_writeoptions(SEXP r_writeoptions,
                                                   bool closed_error);
 bool check_iterator(leveldb_iterator_t *it, SEXP r_error_if_invalid);
+rleveldb_stats* rleveldb_get_stats(SEXP r_db);
+const rleveldb_comparator* rleveldb_get_comparator(SEXP r_db);
+rleveldb_writer* rleveldb_get_writer(SEXP r_writer, bool closed_error);
+void rleveldb_writer_check(rleveldb_writer *writer);
+void rleveldb_close_writers(SEXP r_db);
+rleveldb_prefetch* rleveldb_get_prefetch(SEXP r_prefetch, bool closed_error);
+void rleveldb_close_prefetchers(SEXP r_db);
 
 
 // Finalisers
@@ -26,8 +49,10 @@ static void rleveldb_snapshot_finalize(SEXP r_snapshot);
 static void rleveldb_writebatch_finalize(SEXP r_writebatch);
 static void rleveldb_readoptions_finalize(SEXP r_readoptions);
 static void rleveldb_writeoptions_finalize(SEXP r_writeoptions);
-static void rleveldb_cache_finalize(SEXP r_cache);
-static void rleveldb_filterpolicy_finalize(SEXP r_filterpolicy);
+static void rleveldb_cache_destroy(void *cache);
+static void rleveldb_filterpolicy_destroy(void *filterpolicy);
+static void rleveldb_writer_finalize(SEXP r_writer);
+static void rleveldb_prefetch_finalize(SEXP r_prefetch);
 
 
 // Other internals
@@ -39,22 +64,195 @@ leveldb_options_t* rleveldb_collect_options(SEXP r_create_if_missing,
                                             SEXP r_max_open_files,
                                             SEXP r_block_size,
                                             SEXP r_use_compression);
-bool iter_key_starts_with(leveldb_iterator_t *it, const char *starts_with,
-                          size_t starts_with_len);
 
 // Slightly different
-size_t rleveldb_get_keys_len(leveldb_t *db,
-                             const char *starts_with, size_t starts_with_len,
-                             leveldb_readoptions_t *readoptions);
+size_t rleveldb_get_keys_len(leveldb_t *db, const rleveldb_range *range,
+                             const rleveldb_filter *filter,
+                             leveldb_readoptions_t *readoptions,
+                             rleveldb_stats *stats);
 void rleveldb_get_exists(leveldb_t *db, size_t num_key,
                          const char **key_data, size_t *key_len,
-                         leveldb_readoptions_t *readoptions, int *found);
+                         leveldb_readoptions_t *readoptions, int *found,
+                         rleveldb_stats *stats);
+SEXP rleveldb_scan_result(collector *keys, collector *values,
+                          return_as as_raw);
+SEXP rleveldb_iter_step_n(SEXP r_it, SEXP r_n, SEXP r_as_raw, bool forward);
+void rleveldb_mget_parallel(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                            size_t num_key, const char **key_data,
+                            size_t *key_len, return_as as_raw,
+                            size_t nthreads, char **reads, size_t *reads_len);
+void rleveldb_mget_sorted(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                          size_t num_key, const char **key_data,
+                          size_t *key_len, return_as as_raw,
+                          SEXP ret, bool *found, rleveldb_stats *stats);
+
+typedef enum parallel_scan_what {
+  PARALLEL_SCAN_COUNT,
+  PARALLEL_SCAN_KEYS,
+  PARALLEL_SCAN_SCAN
+} parallel_scan_what;
+
+// The state of one part of a parallel scan.  This is filled in on a
+// worker thread, so the collectors are native.
+typedef struct parallel_scan_part {
+  rleveldb_range range;
+  collector keys;
+  collector values;
+  double scanned;
+  double n;
+  double key_bytes;
+  double value_bytes;
+  char *err;
+} parallel_scan_part;
+
+// n parts, plus a spare one that the results are merged into
+typedef struct parallel_scan_parts {
+  size_t n;
+  parallel_scan_part *part;
+} parallel_scan_parts;
+
+typedef struct parallel_scan_data {
+  leveldb_t *db;
+  leveldb_readoptions_t *readoptions;
+  const rleveldb_filter *filter;
+  parallel_scan_what what;
+  parallel_scan_part *parts;
+} parallel_scan_data;
+
+static void parallel_scan_worker(void *data, size_t from, size_t to);
+static void parallel_scan_release(SEXP r_parts);
+
+// Long operations that are run off the R thread (see task.h)
+typedef struct repair_task {
+  const char *path;
+  const rleveldb_comparator *comparator;
+  char *err;
+} repair_task;
+
+// A write batch made from R keeps counts of what has been added to it
+// (in a raw vector as its tag) for the statistics, as leveldb could
+// only say by walking the whole batch.  'reserved' counts the keys
+// reserved for namespaces, which may only be written through one.
+typedef struct writebatch_count {
+  size_t puts;
+  size_t deletes;
+  size_t bytes;
+  size_t reserved;
+} writebatch_count;
+
+static writebatch_count* rleveldb_get_writebatch_count(SEXP r_writebatch);
+static void writebatch_put(leveldb_writebatch_t *writebatch,
+                           writebatch_count *count,
+                           const char *key_data, size_t key_len,
+                           const char *value_data, size_t value_len);
+static void writebatch_delete(leveldb_writebatch_t *writebatch,
+                              writebatch_count *count,
+                              const char *key_data, size_t key_len);
+
+typedef struct write_task {
+  leveldb_t *db;
+  leveldb_writeoptions_t *writeoptions;
+  leveldb_writebatch_t *writebatch;
+  writebatch_count count;
+  char *err;
+} write_task;
+
+// Compaction is done in pieces (split as by size_histogram) so that
+// it can be cancelled, and its progress reported, between them.
+#define COMPACT_PIECES 16
+
+typedef struct compact_task {
+  leveldb_t *db;
+  size_t n;
+  const char **bounds;
+  size_t *bounds_len;
+  uint64_t *sizes;
+  size_t done;
+} compact_task;
+
+// Writes smaller than this, and scans of fewer keys, are done on the
+// R thread (unless a progress callback is given) as they are over
+// too quickly to be worth starting a thread for.
+#define WRITE_INLINE_BYTES 1048576
+#define KEYS_INLINE 10000
+
+// Owned by an external pointer, as the collector is native.  The
+// iterator is created on the R thread and destroyed by whichever
+// thread finishes the pass.
+typedef struct keys_task {
+  leveldb_t *db;
+  const rleveldb_filter *filter;
+  rleveldb_range range;
+  leveldb_iterator_t *it;
+  collector keys;
+  size_t scanned;
+} keys_task;
+
+static void repair_task_work(rleveldb_task *task, void *data);
+static void write_task_work(rleveldb_task *task, void *data);
+static void compact_task_work(rleveldb_task *task, void *data);
+static void keys_task_work(rleveldb_task *task, void *data);
+static bool keys_task_step(keys_task *d, rleveldb_task *task, size_t budget);
+static void keys_task_release(SEXP r_data);
+
+// The range-level parts of keys(), scan() and delete_range(), which
+// are shared with namespaces
+static SEXP keys_range(leveldb_t *db, const rleveldb_range *range,
+                       const rleveldb_filter *filter, return_as as_raw,
+                       SEXP r_progress, leveldb_readoptions_t *readoptions,
+                       rleveldb_stats *stats);
+static SEXP scan_range(leveldb_t *db, const rleveldb_range *range,
+                       const rleveldb_filter *filter, return_as as_raw,
+                       leveldb_readoptions_t *readoptions,
+                       rleveldb_stats *stats);
+static size_t delete_range(leveldb_t *db, const rleveldb_range *range,
+                           size_t batch_size, bool compact,
+                           leveldb_writeoptions_t *writeoptions,
+                           rleveldb_stats *stats);
+
+static size_t namespace_next_id(leveldb_t *db,
+                                const rleveldb_comparator *comparator);
+static double namespace_size(leveldb_t *db,
+                             const rleveldb_comparator *comparator,
+                             SEXP r_prefix);
+static bool namespace_in_use(leveldb_t *db);
+static void namespace_reserve(SEXP r_db);
+static bool rleveldb_reserved(SEXP r_db);
+static void check_unreserved(SEXP r_db, size_t num_key,
+                             const char **key_data, const size_t *key_len);
+static void get_db_range(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                         SEXP r_end, SEXP r_limit, rleveldb_range *range);
+
+// An operation on a namespace, run by namespace_run
+typedef SEXP namespace_op(SEXP r_db, SEXP r_ns, SEXP *args);
+static SEXP namespace_run(SEXP r_ns, namespace_op *op, SEXP *args);
+static namespace_op ns_get, ns_mget, ns_put, ns_mput, ns_delete, ns_exists,
+  ns_keys, ns_keys_len, ns_scan, ns_delete_range;
+
+static const rleveldb_comparator* get_comparator(SEXP r_comparator);
+static rleveldb_env* get_env(SEXP r_env);
+static SEXP get_cache(SEXP r_cache_capacity);
+static SEXP get_filterpolicy(SEXP r_bloom_filter_bits_per_key);
+static void release_shared(SEXP tag);
+
+// Envs, caches and filter policies may be shared between databases
+// (see shared.h)
+#define ENV_TYPE "leveldb_env"
+#define CACHE_TYPE "leveldb_cache"
+#define FILTERPOLICY_TYPE "leveldb_bloom_filter"
 
 enum rleveldb_tag_index {
   TAG_PATH,
   TAG_CACHE,
   TAG_FILTERPOLICY,
   TAG_ITERATORS,
+  TAG_STATS,
+  TAG_WRITERS,
+  TAG_PREFETCHERS,
+  TAG_NAMESPACES,
+  TAG_COMPARATOR,
+  TAG_ENV,
+  TAG_RESERVED,
   TAG_LENGTH // don't store anything here!
 };
 
@@ -68,46 +266,45 @@ SEXP rleveldb_open(SEXP r_path,
                       SEXP r_block_size,
                       SEXP r_use_compression,
                       SEXP r_cache_capacity,
-                      SEXP r_bloom_filter_bits_per_key) {
+                      SEXP r_bloom_filter_bits_per_key,
+                      SEXP r_comparator,
+                      SEXP r_env) {
   // Unimplemented options:
   // * a general set_filter_policy
-  // * set_env
   // * set_info_log
-  // * set_comparator
   // * restart_interval
   //
-  // There is some gymnastics here to avoid leaking in the case of an
-  // R error (perhaps thrown by the coersion functions).
-  SEXP r_cache_ptr = R_NilValue, r_filterpolicy_ptr = R_NilValue;
-  leveldb_cache_t* cache = NULL;
-  leveldb_filterpolicy_t* filterpolicy = NULL;
-  bool
-    has_cache = r_cache_capacity != R_NilValue,
-    has_filterpolicy = r_bloom_filter_bits_per_key != R_NilValue;
-  if (has_cache) {
-    cache = leveldb_cache_create_lru(scalar_size(r_cache_capacity));
-    r_cache_ptr = PROTECT(R_MakeExternalPtr(cache, R_NilValue, R_NilValue));
-    R_RegisterCFinalizer(r_cache_ptr, rleveldb_cache_finalize);
-  }
-  if (has_filterpolicy) {
-    size_t bits_per_key = scalar_size(r_bloom_filter_bits_per_key);
-    filterpolicy = leveldb_filterpolicy_create_bloom(bits_per_key);
-    r_filterpolicy_ptr =
-      PROTECT(R_MakeExternalPtr(filterpolicy, R_NilValue, R_NilValue));
-    R_RegisterCFinalizer(r_filterpolicy_ptr, rleveldb_filterpolicy_finalize);
-  }
+  // The cache and filter policy are either shared ones, or made here
+  // for this database alone (as a number).  Either way they are owned
+  // by R objects, so nothing leaks if an R error is thrown (perhaps by
+  // the coersion functions) before the database is open.
+  const rleveldb_comparator *comparator = get_comparator(r_comparator);
+  rleveldb_env *env = get_env(r_env);
+  SEXP r_cache = PROTECT(get_cache(r_cache_capacity));
+  SEXP r_filterpolicy =
+    PROTECT(get_filterpolicy(r_bloom_filter_bits_per_key));
   const char *path = scalar_character(r_path);
   leveldb_options_t *options =
     rleveldb_collect_options(r_create_if_missing, r_error_if_exists,
                              r_paranoid_checks, r_write_buffer_size,
                              r_max_open_files, r_block_size,
                              r_use_compression);
-  if (has_cache) {
+  if (r_cache != R_NilValue) {
+    leveldb_cache_t *cache =
+      (leveldb_cache_t*) shared_get(r_cache, CACHE_TYPE);
     leveldb_options_set_cache(options, cache);
   }
-  if (has_filterpolicy) {
+  if (r_filterpolicy != R_NilValue) {
+    leveldb_filterpolicy_t *filterpolicy =
+      (leveldb_filterpolicy_t*) shared_get(r_filterpolicy, FILTERPOLICY_TYPE);
     leveldb_options_set_filter_policy(options, filterpolicy);
   }
+  if (!comparator_is_bytewise(comparator)) {
+    leveldb_options_set_comparator(options, comparator_leveldb(comparator));
+  }
+  if (env != NULL) {
+    leveldb_options_set_env(options, env_leveldb(env));
+  }
 
   char *err = NULL;
   leveldb_t *db = leveldb_open(options, path, &err);
@@ -116,13 +313,30 @@ SEXP rleveldb_open(SEXP r_path,
 
   SEXP tag = PROTECT(allocVector(VECSXP, TAG_LENGTH));
   SET_VECTOR_ELT(tag, TAG_PATH, r_path);
-  SET_VECTOR_ELT(tag, TAG_CACHE, r_cache_ptr);
-  SET_VECTOR_ELT(tag, TAG_FILTERPOLICY, r_filterpolicy_ptr);
+  // The database holds a reference to its cache, filter policy and
+  // env until it is closed (see release_shared)
+  SET_VECTOR_ELT(tag, TAG_CACHE, r_cache == R_NilValue ?
+                 R_NilValue : shared_lease(r_cache, CACHE_TYPE));
+  SET_VECTOR_ELT(tag, TAG_FILTERPOLICY, r_filterpolicy == R_NilValue ?
+                 R_NilValue : shared_lease(r_filterpolicy, FILTERPOLICY_TYPE));
   SET_VECTOR_ELT(tag, TAG_ITERATORS, R_NilValue); // will be a pairlist
+  SET_VECTOR_ELT(tag, TAG_STATS, stats_create());
+  SET_VECTOR_ELT(tag, TAG_WRITERS, R_NilValue); // will be a pairlist
+  SET_VECTOR_ELT(tag, TAG_PREFETCHERS, R_NilValue); // will be a pairlist
+  SET_VECTOR_ELT(tag, TAG_NAMESPACES, R_NilValue); // will be a pairlist
+  SET_VECTOR_ELT(tag, TAG_COMPARATOR,
+                 ScalarInteger(comparator_type_of(comparator)));
+  SET_VECTOR_ELT(tag, TAG_ENV,
+                 env == NULL ? R_NilValue : shared_lease(r_env, ENV_TYPE));
+  SET_VECTOR_ELT(tag, TAG_RESERVED, ScalarLogical(false));
 
   SEXP r_db = PROTECT(R_MakeExternalPtr(db, tag, R_NilValue));
   R_RegisterCFinalizer(r_db, rleveldb_finalize);
-  UNPROTECT(2 + has_cache + has_filterpolicy);
+  // Looked up once the database will be closed if this throws
+  if (namespace_in_use(db)) {
+    namespace_reserve(r_db);
+  }
+  UNPROTECT(4);
   return r_db;
 }
 
@@ -130,6 +344,8 @@ SEXP rleveldb_open(SEXP r_path,
 SEXP rleveldb_close(SEXP r_db, SEXP r_error_if_closed) {
   leveldb_t *db = rleveldb_get_db(r_db, scalar_logical(r_error_if_closed));
   if (db != NULL) {
+    rleveldb_close_writers(r_db);
+    rleveldb_close_prefetchers(r_db);
     SEXP tag = rleveldb_tag(r_db);
     SEXP r_iterators = VECTOR_ELT(tag, TAG_ITERATORS);
     while (r_iterators != R_NilValue) {
@@ -137,14 +353,19 @@ SEXP rleveldb_close(SEXP r_db, SEXP r_error_if_closed) {
       r_iterators = CDR(r_iterators);
     }
     leveldb_close(db);
+    release_shared(tag);
     R_ClearExternalPtr(r_db);
   }
   return ScalarLogical(db != NULL);
 }
 
-SEXP rleveldb_destroy(SEXP r_path) {
+SEXP rleveldb_destroy(SEXP r_path, SEXP r_env) {
   const char *path = scalar_character(r_path);
+  rleveldb_env *env = get_env(r_env);
   leveldb_options_t *options = leveldb_options_create();
+  if (env != NULL) {
+    leveldb_options_set_env(options, env_leveldb(env));
+  }
   char *err = NULL;
   leveldb_destroy_db(options, path, &err);
   leveldb_options_destroy(options);
@@ -152,13 +373,22 @@ SEXP rleveldb_destroy(SEXP r_path) {
   return ScalarLogical(true);
 }
 
-SEXP rleveldb_repair(SEXP r_path) {
-  const char *path = scalar_character(r_path);
-  leveldb_options_t *options = leveldb_options_create();
-  char *err = NULL;
-  leveldb_repair_db(options, path, &err);
-  leveldb_options_destroy(options);
-  rleveldb_handle_error(err);
+// leveldb can't stop a repair part way through, so an interrupt only
+// takes effect once it has finished.
+SEXP rleveldb_repair(SEXP r_path, SEXP r_comparator, SEXP r_progress) {
+  repair_task data;
+  data.path = scalar_character(r_path);
+  data.comparator = get_comparator(r_comparator);
+  data.err = NULL;
+  task_status status = task_run(repair_task_work, &data, r_progress);
+  if (status != TASK_DONE) {
+    bool completed = data.err == NULL;
+    if (!completed) {
+      leveldb_free(data.err);
+    }
+    task_error(status, "repair", completed);
+  }
+  rleveldb_handle_error(data.err);
   return ScalarLogical(true);
 }
 
@@ -180,25 +410,30 @@ SEXP rleveldb_property(SEXP r_db, SEXP r_name, SEXP r_error_if_missing) {
 }
 
 SEXP rleveldb_get(SEXP r_db, SEXP r_key, SEXP r_as_raw,
-                  SEXP r_error_if_missing, SEXP r_readoptions) {
+                  SEXP r_error_if_missing, SEXP r_zero_copy,
+                  SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
   const char *key_data = NULL;
   size_t key_len = get_key(r_key, &key_data);
 
   bool error_if_missing = scalar_logical(r_error_if_missing);
+  bool zero_copy = scalar_logical(r_zero_copy);
   return_as as_raw = to_return_as(r_as_raw);
   leveldb_readoptions_t *readoptions =
     rleveldb_get_readoptions(r_readoptions, true);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
 
+  double start = stats_now();
   char *err = NULL;
   size_t read_len;
   char* read = leveldb_get(db, readoptions, key_data, key_len, &read_len, &err);
   rleveldb_handle_error(err);
+  stats_latency(stats, STATS_OP_GET, start);
+  stats_read(stats, STATS_PATH_GET, read, read_len);
 
   SEXP ret;
   if (read != NULL) {
-    ret = raw_string_to_sexp(read, read_len, as_raw);
-    leveldb_free(read);
+    ret = leveldb_buffer_to_sexp(read, read_len, as_raw, zero_copy);
   } else if (!error_if_missing) {
     ret = R_NilValue;
   } else if (TYPEOF(r_key) == STRSXP) {
@@ -212,12 +447,22 @@ SEXP rleveldb_get(SEXP r_db, SEXP r_key, SEXP r_as_raw,
 
 SEXP rleveldb_mget(SEXP r_db, SEXP r_key, SEXP r_as_raw,
                    SEXP r_missing_value, SEXP r_missing_report,
+                   SEXP r_nthreads, SEXP r_sorted, SEXP r_zero_copy,
                    SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
   leveldb_readoptions_t *readoptions =
     rleveldb_get_readoptions(r_readoptions, true);
   return_as as_raw = to_return_as(r_as_raw);
   bool missing_report = scalar_logical(r_missing_report);
+  size_t nthreads = scalar_size(r_nthreads);
+  bool sorted = scalar_logical(r_sorted);
+  bool zero_copy = scalar_logical(r_zero_copy);
+  if (sorted && nthreads > 1) {
+    Rf_error("Can't use both sorted = TRUE and nthreads > 1");
+  }
+  // The sorted sweep relies on keys being in bytewise order; under
+  // any other comparator the keys are just looked up one at a time.
+  sorted = sorted && comparator_is_bytewise(rleveldb_get_comparator(r_db));
   if (as_raw == AS_STRING) {
     if (r_missing_value == R_NilValue) {
       r_missing_value = NA_STRING;
@@ -233,25 +478,62 @@ SEXP rleveldb_mget(SEXP r_db, SEXP r_key, SEXP r_as_raw,
   size_t *key_len = NULL;
   size_t num_key = get_keys(r_key, &key_data, &key_len);
   bool *missing = NULL;
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  double start = stats_now();
+
+  // With more than one thread, all the reads happen up front, off the
+  // R thread, and we then convert them to R objects below.
+  bool parallel = nthreads > 1 && num_key > 1;
+  stats_path path = parallel ? STATS_PATH_MGET_PARALLEL :
+    (sorted ? STATS_PATH_MGET_SORTED : STATS_PATH_MGET);
+  char **reads = NULL;
+  size_t *reads_len = NULL;
+  if (parallel) {
+    reads = (char**) R_alloc(num_key, sizeof(char*));
+    reads_len = (size_t*) R_alloc(num_key, sizeof(size_t));
+    rleveldb_mget_parallel(db, readoptions, num_key, key_data, key_len,
+                           as_raw, nthreads, reads, reads_len);
+  }
 
   SEXPTYPE ret_type = as_raw == AS_STRING ? STRSXP : VECSXP;
   SEXP ret = PROTECT(allocVector(ret_type, num_key));
 
+  // The sorted strategy fills in everything that was found directly,
+  // leaving just the missing values to be dealt with below.
+  bool *found = NULL;
+  if (sorted) {
+    found = (bool*) R_alloc(num_key, sizeof(bool));
+    rleveldb_mget_sorted(db, readoptions, num_key, key_data, key_len,
+                         as_raw, ret, found, stats);
+  }
+
   size_t n_missing = 0;
   for (size_t i = 0; i < num_key; ++i) {
-    char *err = NULL;
-    size_t read_len;
-    char* read = leveldb_get(db, readoptions, key_data[i], key_len[i],
-                             &read_len, &err);
-    rleveldb_handle_error(err);
+    size_t read_len = 0;
+    char* read;
+    if (sorted) {
+      if (found[i]) {
+        continue;
+      }
+      read = NULL;
+    } else if (parallel) {
+      read = reads[i];
+      read_len = reads_len[i];
+    } else {
+      char *err = NULL;
+      read = leveldb_get(db, readoptions, key_data[i], key_len[i],
+                         &read_len, &err);
+      rleveldb_handle_error(err);
+    }
+    stats_read(stats, path, read, read_len);
     if (read != NULL) {
-      SEXP el = PROTECT(raw_string_to_sexp(read, read_len, as_raw));
+      SEXP el =
+        PROTECT(leveldb_buffer_to_sexp(read, read_len, as_raw, zero_copy));
       if (as_raw == AS_STRING) {
         SET_STRING_ELT(ret, i, STRING_ELT(el, 0));
       } else {
         SET_VECTOR_ELT(ret, i, el);
       }
-      leveldb_free(read);
       UNPROTECT(1);
     } else {
       if (as_raw == AS_STRING) {
@@ -281,6 +563,7 @@ SEXP rleveldb_mget(SEXP r_db, SEXP r_key, SEXP r_as_raw,
     UNPROTECT(1);
   }
 
+  stats_latency(stats, STATS_OP_MGET, start);
   UNPROTECT(1);
   return ret;
 }
@@ -293,10 +576,17 @@ SEXP rleveldb_put(SEXP r_db, SEXP r_key, SEXP r_value, SEXP r_writeoptions) {
   size_t
     key_len = get_key(r_key, &key_data),
     value_len = get_value(r_value, &value_data);
+  check_unreserved(r_db, 1, &key_data, &key_len);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
 
+  double start = stats_now();
   char *err = NULL;
   leveldb_put(db, writeoptions, key_data, key_len, value_data, value_len, &err);
   rleveldb_handle_error(err);
+  stats_latency(stats, STATS_OP_PUT, start);
+  stats->puts++;
+  stats->writes++;
+  stats->bytes_written += key_len + value_len;
 
   return R_NilValue;
 }
@@ -310,37 +600,188 @@ SEXP rleveldb_put(SEXP r_db, SEXP r_key, SEXP r_value, SEXP r_writeoptions) {
 SEXP rleveldb_mput(SEXP r_db, SEXP r_key, SEXP r_value, SEXP r_writeoptions) {
   SEXP r_writebatch = PROTECT(rleveldb_writebatch_create());
   rleveldb_writebatch_mput(r_writebatch, r_key, r_value);
-  rleveldb_write(r_db, r_writebatch, r_writeoptions);
+  rleveldb_write(r_db, r_writebatch, R_NilValue, r_writeoptions);
+  rleveldb_writebatch_destroy(r_writebatch, ScalarLogical(false));
   UNPROTECT(1);
   return R_NilValue;
 }
 
-SEXP rleveldb_delete(SEXP r_db, SEXP r_key, SEXP r_report,
-                     SEXP r_readoptions, SEXP r_writeoptions) {
-  if (scalar_logical(r_report)) {
-    return rleveldb_delete_report(r_db, r_key, r_readoptions, r_writeoptions);
+// Store R objects directly, serialising into (and out of) a buffer
+// that is passed straight to leveldb, rather than via a raw vector
+// created by serialize() in R.
+SEXP rleveldb_put_object(SEXP r_db, SEXP r_key, SEXP r_value,
+                         SEXP r_compact, SEXP r_writeoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  leveldb_writeoptions_t *writeoptions =
+    rleveldb_get_writeoptions(r_writeoptions, true);
+  const char *key_data = NULL;
+  size_t key_len = get_key(r_key, &key_data);
+  check_unreserved(r_db, 1, &key_data, &key_len);
+  bool compact = scalar_logical(r_compact);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+
+  SEXP r_buffer;
+  object_buffer *buffer = object_buffer_create(&r_buffer);
+  PROTECT(r_buffer);
+  object_serialize(r_value, compact, buffer);
+  size_t value_len = buffer->len;
+
+  double start = stats_now();
+  char *err = NULL;
+  leveldb_put(db, writeoptions, key_data, key_len,
+              (const char*) buffer->data, value_len, &err);
+  object_buffer_release(r_buffer);
+  rleveldb_handle_error(err);
+  stats_latency(stats, STATS_OP_PUT, start);
+  stats->puts++;
+  stats->writes++;
+  stats->bytes_written += key_len + value_len;
+
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP rleveldb_get_object(SEXP r_db, SEXP r_key, SEXP r_error_if_missing,
+                         SEXP r_readoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  const char *key_data = NULL;
+  size_t key_len = get_key(r_key, &key_data);
+  bool error_if_missing = scalar_logical(r_error_if_missing);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+
+  double start = stats_now();
+  char *err = NULL;
+  size_t read_len;
+  char* read = leveldb_get(db, readoptions, key_data, key_len, &read_len, &err);
+  rleveldb_handle_error(err);
+  stats_latency(stats, STATS_OP_GET, start);
+  stats_read(stats, STATS_PATH_OBJECT, read, read_len);
+
+  if (read != NULL) {
+    return leveldb_buffer_to_object(read, read_len);
+  } else if (!error_if_missing) {
+    return R_NilValue;
+  } else if (TYPEOF(r_key) == STRSXP) {
+    Rf_error("Key '%s' not found in database", key_data);
   } else {
-    return rleveldb_delete_silent(r_db, r_key, r_writeoptions);
+    Rf_error("Key not found in database");
   }
 }
 
-// This is the simple delete: it just deletes things and does not
-// report back anything about what was done (these keys may or may not
-// exist).
-SEXP rleveldb_delete_silent(SEXP r_db, SEXP r_key, SEXP r_writeoptions) {
+SEXP rleveldb_mget_object(SEXP r_db, SEXP r_key, SEXP r_missing_report,
+                          SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+  bool missing_report = scalar_logical(r_missing_report);
   const char **key_data = NULL;
   size_t *key_len = NULL;
   size_t num_key = get_keys(r_key, &key_data, &key_len);
-  leveldb_writeoptions_t *writeoptions =
-    rleveldb_get_writeoptions(r_writeoptions, true);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  double start = stats_now();
 
+  SEXP ret = PROTECT(allocVector(VECSXP, num_key));
+  size_t n_missing = 0;
+  bool *missing = (bool*) R_alloc(num_key, sizeof(bool));
   for (size_t i = 0; i < num_key; ++i) {
     char *err = NULL;
-    leveldb_delete(db, writeoptions, key_data[i], key_len[i], &err);
+    size_t read_len;
+    char* read = leveldb_get(db, readoptions, key_data[i], key_len[i],
+                             &read_len, &err);
     rleveldb_handle_error(err);
+    stats_read(stats, STATS_PATH_OBJECT, read, read_len);
+    missing[i] = read == NULL;
+    if (read != NULL) {
+      SET_VECTOR_ELT(ret, i, leveldb_buffer_to_object(read, read_len));
+    } else {
+      n_missing++;
+    }
+  }
+
+  if (missing_report && n_missing > 0) {
+    SEXP ret_missing = PROTECT(allocVector(INTSXP, n_missing));
+    for (size_t i = 0, j = 0; i < num_key; ++i) {
+      if (missing[i]) {
+        INTEGER(ret_missing)[j++] = i + 1;
+      }
+    }
+    setAttrib(ret, install("missing"), ret_missing);
+    UNPROTECT(1);
+  }
+
+  stats_latency(stats, STATS_OP_MGET, start);
+  UNPROTECT(1);
+  return ret;
+}
+
+// All values are serialised into one buffer before anything is added
+// to the writebatch, so a value that can't be serialised leaves the
+// database untouched.
+SEXP rleveldb_mput_object(SEXP r_db, SEXP r_key, SEXP r_value,
+                          SEXP r_compact, SEXP r_writeoptions) {
+  rleveldb_get_db(r_db, true);
+  const char **key_data = NULL;
+  size_t *key_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  bool compact = scalar_logical(r_compact);
+  if (TYPEOF(r_value) != VECSXP) {
+    Rf_error("Expected a list for 'value'");
   }
+  if ((size_t)length(r_value) != num_key) {
+    Rf_error("Expected %d values but recieved %d",
+             (int) num_key, length(r_value));
+  }
+
+  SEXP r_buffer;
+  object_buffer *buffer = object_buffer_create(&r_buffer);
+  PROTECT(r_buffer);
+  size_t *offset = (size_t*) R_alloc(num_key + 1, sizeof(size_t));
+  offset[0] = 0;
+  for (size_t i = 0; i < num_key; ++i) {
+    object_serialize(VECTOR_ELT(r_value, i), compact, buffer);
+    offset[i + 1] = buffer->len;
+  }
+
+  SEXP r_writebatch = PROTECT(rleveldb_writebatch_create());
+  leveldb_writebatch_t *writebatch =
+    rleveldb_get_writebatch(r_writebatch, true);
+  writebatch_count *count = rleveldb_get_writebatch_count(r_writebatch);
+  for (size_t i = 0; i < num_key; ++i) {
+    writebatch_put(writebatch, count, key_data[i], key_len[i],
+                   (const char*) buffer->data + offset[i],
+                   offset[i + 1] - offset[i]);
+  }
+  object_buffer_release(r_buffer);
+  rleveldb_write(r_db, r_writebatch, R_NilValue, r_writeoptions);
+  rleveldb_writebatch_destroy(r_writebatch, ScalarLogical(false));
+
+  UNPROTECT(2);
+  return R_NilValue;
+}
+
+SEXP rleveldb_delete(SEXP r_db, SEXP r_key, SEXP r_report,
+                     SEXP r_readoptions, SEXP r_writeoptions) {
+  if (scalar_logical(r_report)) {
+    return rleveldb_delete_report(r_db, r_key, r_readoptions, r_writeoptions);
+  } else {
+    return rleveldb_delete_silent(r_db, r_key, r_writeoptions);
+  }
+}
 
+// This is the simple delete: it just deletes things and does not
+// report back anything about what was done (these keys may or may not
+// exist).  As with mput, all the deletions go through a single
+// writebatch so that they are applied atomically with one log write
+// (and one sync, if requested).
+SEXP rleveldb_delete_silent(SEXP r_db, SEXP r_key, SEXP r_writeoptions) {
+  rleveldb_get_db(r_db, true);
+  SEXP r_writebatch = PROTECT(rleveldb_writebatch_create());
+  rleveldb_writebatch_mdelete(r_writebatch, r_key);
+  rleveldb_write(r_db, r_writebatch, R_NilValue, r_writeoptions);
+  rleveldb_writebatch_destroy(r_writebatch, ScalarLogical(false));
+  UNPROTECT(1);
   return R_NilValue;
 }
 
@@ -353,34 +794,41 @@ SEXP rleveldb_delete_report(SEXP r_db, SEXP r_key, SEXP r_readoptions,
   const char **key_data = NULL;
   size_t *key_len = NULL;
   size_t num_key = get_keys(r_key, &key_data, &key_len);
+  check_unreserved(r_db, num_key, key_data, key_len);
 
   // This might fail so I'm doing it up here
   leveldb_writeoptions_t *writeoptions =
     rleveldb_get_writeoptions(r_writeoptions, true);
 
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+
   SEXP r_found = PROTECT(allocVector(LGLSXP, num_key));
   int *found = INTEGER(r_found);
 
-  leveldb_readoptions_t *readoptions = default_readoptions;
+  // First, work out what exists (this may throw on read error):
+  rleveldb_get_exists(db, num_key, key_data, key_len, readoptions, found,
+                      stats);
+
   // NOTE: leak danger on throw, so nothing between here and the
   // writebatch_destroys may throw (and therefore can't use the R
   // API).
   leveldb_writebatch_t *writebatch = leveldb_writebatch_create();
 
-  // First, work out what exists:
-  rleveldb_get_exists(db, num_key, key_data, key_len, readoptions, found);
-
-  bool do_delete = false;
+  writebatch_count count = {0, 0, 0, 0};
   for (size_t i = 0; i < num_key; ++i) {
     if (found[i]) {
-      leveldb_writebatch_delete(writebatch, key_data[i], key_len[i]);
-      do_delete = true;
+      writebatch_delete(writebatch, &count, key_data[i], key_len[i]);
     }
   }
 
-  if (do_delete) {
+  if (count.deletes > 0) {
+    double start = stats_now();
     char *err = NULL;
     leveldb_write(db, writeoptions, writebatch, &err);
+    stats_latency(stats, STATS_OP_WRITE, start);
+    stats_write(stats, count.puts, count.deletes, count.bytes);
     // NOTE: This must come here *and* in the else (but not outside
     // the if/else) because that way we don't leak the writebatch
     // object on error.
@@ -394,6 +842,361 @@ SEXP rleveldb_delete_report(SEXP r_db, SEXP r_key, SEXP r_readoptions,
   return r_found;
 }
 
+// Delete every key within a range, without the keys ever going
+// through R.  Deletions are streamed into write batches of at most
+// batch_size keys so that memory use stays bounded.  The iterator
+// works from an implicit snapshot so it is unaffected by the
+// deletions.  Returns the number of keys deleted.
+SEXP rleveldb_delete_range(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                           SEXP r_end, SEXP r_batch_size, SEXP r_compact,
+                           SEXP r_writeoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, R_NilValue, &range);
+  size_t batch_size = scalar_size(r_batch_size);
+  if (batch_size == 0) {
+    Rf_error("batch_size must be at least 1");
+  }
+  bool compact = scalar_logical(r_compact);
+  leveldb_writeoptions_t *writeoptions =
+    rleveldb_get_writeoptions(r_writeoptions, true);
+  size_t n = delete_range(db, &range, batch_size, compact, writeoptions,
+                          rleveldb_get_stats(r_db));
+  return ScalarReal(n);
+}
+
+static size_t delete_range(leveldb_t *db, const rleveldb_range *range,
+                           size_t batch_size, bool compact,
+                           leveldb_writeoptions_t *writeoptions,
+                           rleveldb_stats *stats) {
+  const char *lower = NULL, *upper = NULL;
+  size_t
+    lower_len = range_lower(range, &lower),
+    upper_len = range_upper(range, &upper);
+
+  // NOTE: leak danger on throw, so nothing between here and the
+  // destroys may throw.
+  leveldb_readoptions_t *readoptions = leveldb_readoptions_create();
+  leveldb_readoptions_set_fill_cache(readoptions, false);
+  leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
+  leveldb_writebatch_t *writebatch = leveldb_writebatch_create();
+  writebatch_count count = {0, 0, 0, 0};
+  char *err = NULL;
+  size_t n = 0;
+  for (range_seek(it, range); range_valid(it, range);
+       leveldb_iter_next(it)) {
+    size_t key_len;
+    const char *key_data = leveldb_iter_key(it, &key_len);
+    writebatch_delete(writebatch, &count, key_data, key_len);
+    ++n;
+    if (count.deletes == batch_size) {
+      double start = stats_now();
+      leveldb_write(db, writeoptions, writebatch, &err);
+      stats_latency(stats, STATS_OP_WRITE, start);
+      stats_write(stats, count.puts, count.deletes, count.bytes);
+      if (err != NULL) {
+        break;
+      }
+      leveldb_writebatch_clear(writebatch);
+      count.deletes = count.bytes = 0;
+    }
+  }
+  if (err == NULL && count.deletes > 0) {
+    double start = stats_now();
+    leveldb_write(db, writeoptions, writebatch, &err);
+    stats_latency(stats, STATS_OP_WRITE, start);
+    stats_write(stats, count.puts, count.deletes, count.bytes);
+  }
+  leveldb_writebatch_destroy(writebatch);
+  leveldb_iter_destroy(it);
+  leveldb_readoptions_destroy(readoptions);
+  rleveldb_handle_error(err);
+
+  if (compact && n > 0) {
+    leveldb_compact_range(db, lower, lower_len, upper, upper_len);
+  }
+
+  return n;
+}
+
+// Asynchronous writers
+SEXP rleveldb_writer_create(SEXP r_db, SEXP r_sync, SEXP r_batch_keys,
+                            SEXP r_batch_bytes, SEXP r_delay_ms) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  bool sync = scalar_logical(r_sync);
+  size_t batch_keys = scalar_size(r_batch_keys);
+  size_t batch_bytes = scalar_size(r_batch_bytes);
+  double delay = scalar_size(r_delay_ms) / 1000.0;
+  if (batch_keys == 0 || batch_bytes == 0) {
+    Rf_error("batch_keys and batch_bytes must be at least 1");
+  }
+
+  rleveldb_writer *writer =
+    writer_create(db, sync, batch_keys, batch_bytes, delay);
+  if (writer == NULL) {
+    Rf_error("Failed to start writer thread");
+  }
+  SEXP r_writer = PROTECT(R_MakeExternalPtr(writer, r_db, R_NilValue));
+  R_RegisterCFinalizer(r_writer, rleveldb_writer_finalize);
+
+  SEXP db_tag = rleveldb_tag(r_db);
+  SEXP r_writers = VECTOR_ELT(db_tag, TAG_WRITERS);
+  SET_VECTOR_ELT(db_tag, TAG_WRITERS, CONS(r_writer, r_writers));
+
+  UNPROTECT(1);
+  return r_writer;
+}
+
+// Queue puts; returns the sequence number of the last one (compare
+// with 'written' from rleveldb_writer_status)
+SEXP rleveldb_writer_put(SEXP r_writer, SEXP r_key, SEXP r_value) {
+  rleveldb_writer *writer = rleveldb_get_writer(r_writer, true);
+  rleveldb_writer_check(writer);
+  const char **key_data = NULL, **value_data = NULL;
+  size_t *key_len = NULL, *value_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  check_unreserved(R_ExternalPtrTag(r_writer), num_key, key_data, key_len);
+  if (num_key == 1 && TYPEOF(r_value) != VECSXP) {
+    value_data = (const char**) R_alloc(1, sizeof(const char*));
+    value_len = (size_t*) R_alloc(1, sizeof(size_t));
+    value_len[0] = get_value(r_value, value_data);
+  } else {
+    get_values(r_value, num_key, &value_data, &value_len);
+  }
+  uint64_t seq = writer_enqueue(writer, num_key, key_data, key_len,
+                                value_data, value_len);
+  return ScalarReal(seq);
+}
+
+SEXP rleveldb_writer_delete(SEXP r_writer, SEXP r_key) {
+  rleveldb_writer *writer = rleveldb_get_writer(r_writer, true);
+  rleveldb_writer_check(writer);
+  const char **key_data = NULL;
+  size_t *key_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  check_unreserved(R_ExternalPtrTag(r_writer), num_key, key_data, key_len);
+  uint64_t seq = writer_enqueue(writer, num_key, key_data, key_len,
+                                NULL, NULL);
+  return ScalarReal(seq);
+}
+
+// Block until everything queued so far is written, throwing if any
+// write failed.
+SEXP rleveldb_writer_flush(SEXP r_writer) {
+  rleveldb_writer *writer = rleveldb_get_writer(r_writer, true);
+  uint64_t seq = writer_flush(writer);
+  rleveldb_writer_check(writer);
+  return ScalarReal(seq);
+}
+
+SEXP rleveldb_writer_close(SEXP r_writer, SEXP r_error_if_closed) {
+  rleveldb_writer *writer =
+    rleveldb_get_writer(r_writer, scalar_logical(r_error_if_closed));
+  if (writer != NULL) {
+    writer_flush(writer);
+    // Copy the error (if any) before the writer is freed
+    const char *err = writer_error(writer);
+    char *msg = NULL;
+    if (err != NULL) {
+      size_t len = strlen(err);
+      msg = (char*) R_alloc(len + 1, sizeof(char));
+      memcpy(msg, err, len + 1);
+    }
+    writer_close(writer);
+    R_ClearExternalPtr(r_writer);
+    if (msg != NULL) {
+      Rf_error("Asynchronous write failed: %s", msg);
+    }
+  }
+  return ScalarLogical(writer != NULL);
+}
+
+SEXP rleveldb_writer_status(SEXP r_writer) {
+  rleveldb_writer *writer = rleveldb_get_writer(r_writer, true);
+  writer_status status;
+  writer_get_status(writer, &status);
+  const char *names[] = {"submitted", "written", "pending", "batches",
+                         "bytes"};
+  const double values[] = {status.submitted, status.written,
+                           status.submitted - status.written,
+                           status.batches, status.bytes};
+  const size_t n = sizeof(values) / sizeof(double);
+  SEXP ret = PROTECT(allocVector(REALSXP, n));
+  SEXP nms = PROTECT(allocVector(STRSXP, n));
+  for (size_t i = 0; i < n; ++i) {
+    REAL(ret)[i] = values[i];
+    SET_STRING_ELT(nms, i, mkChar(names[i]));
+  }
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return ret;
+}
+
+// Load a large set of (unsorted) keys and values: the keys are sorted
+// natively (in parallel, and by the database's comparator) and then
+// written in key order, in batches of batch_size keys, so that each
+// batch covers a narrow key range and the resulting tables overlap as
+// little as possible.  Where a key is
+// repeated only its last value is written, as would be the case with
+// mput.  Optionally compacts the loaded range afterwards.  Returns
+// the number of distinct keys written.
+SEXP rleveldb_bulk_load(SEXP r_db, SEXP r_key, SEXP r_value,
+                        SEXP r_batch_size, SEXP r_nthreads, SEXP r_compact,
+                        SEXP r_writeoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  const char **key_data = NULL, **value_data = NULL;
+  size_t *key_len = NULL, *value_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  check_unreserved(r_db, num_key, key_data, key_len);
+  get_values(r_value, num_key, &value_data, &value_len);
+  size_t batch_size = scalar_size(r_batch_size);
+  if (batch_size == 0) {
+    Rf_error("batch_size must be at least 1");
+  }
+  size_t nthreads = scalar_size(r_nthreads);
+  bool compact = scalar_logical(r_compact);
+  leveldb_writeoptions_t *writeoptions =
+    rleveldb_get_writeoptions(r_writeoptions, true);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  const rleveldb_comparator *comparator = rleveldb_get_comparator(r_db);
+
+  sorted_key *keys = (sorted_key*) R_alloc(num_key, sizeof(sorted_key));
+  sorted_key *work = (sorted_key*) R_alloc(num_key, sizeof(sorted_key));
+  for (size_t i = 0; i < num_key; ++i) {
+    keys[i].data = key_data[i];
+    keys[i].len = key_len[i];
+    keys[i].index = i;
+  }
+  sort_keys(keys, num_key, comparator, nthreads, work);
+
+  // NOTE: leak danger on throw, so nothing between here and the
+  // writebatch_destroy may throw.
+  leveldb_writebatch_t *writebatch = leveldb_writebatch_create();
+  writebatch_count count = {0, 0, 0, 0};
+  char *err = NULL;
+  size_t n = 0;
+  for (size_t i = 0; i < num_key && err == NULL; ++i) {
+    const sorted_key *k = keys + i;
+    // Duplicates are adjacent and in input order; keep the last
+    if (i + 1 < num_key &&
+        compare_bytes(k->data, k->len, k[1].data, k[1].len) == 0) {
+      continue;
+    }
+    writebatch_put(writebatch, &count, k->data, k->len,
+                   value_data[k->index], value_len[k->index]);
+    ++n;
+    if (count.puts == batch_size || i + 1 == num_key) {
+      double start = stats_now();
+      leveldb_write(db, writeoptions, writebatch, &err);
+      stats_latency(stats, STATS_OP_WRITE, start);
+      stats_write(stats, count.puts, count.deletes, count.bytes);
+      leveldb_writebatch_clear(writebatch);
+      count.puts = count.bytes = 0;
+    }
+  }
+  leveldb_writebatch_destroy(writebatch);
+  rleveldb_handle_error(err);
+
+  if (compact && num_key > 0) {
+    const sorted_key *first = keys, *last = keys + num_key - 1;
+    leveldb_compact_range(db, first->data, first->len, last->data, last->len);
+  }
+
+  return ScalarReal(n);
+}
+
+// Prefetching iterators
+SEXP rleveldb_prefetch_create(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                              SEXP r_end, SEXP r_limit, SEXP r_chunk_size,
+                              SEXP r_depth, SEXP r_readoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, r_limit, &range);
+  size_t chunk_size = scalar_size(r_chunk_size);
+  size_t depth = scalar_size(r_depth);
+  if (chunk_size == 0 || depth == 0) {
+    Rf_error("chunk_size and depth must be at least 1");
+  }
+
+  leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
+  rleveldb_prefetch *prefetch =
+    prefetch_create(it, &range, chunk_size, depth);
+  if (prefetch == NULL) {
+    leveldb_iter_destroy(it);
+    Rf_error("Failed to start prefetch thread");
+  }
+  // The readoptions are kept alive as they may refer to a snapshot
+  SEXP r_prefetch =
+    PROTECT(R_MakeExternalPtr(prefetch, r_db, r_readoptions));
+  R_RegisterCFinalizer(r_prefetch, rleveldb_prefetch_finalize);
+
+  SEXP db_tag = rleveldb_tag(r_db);
+  SEXP r_prefetchers = VECTOR_ELT(db_tag, TAG_PREFETCHERS);
+  SET_VECTOR_ELT(db_tag, TAG_PREFETCHERS, CONS(r_prefetch, r_prefetchers));
+
+  UNPROTECT(1);
+  return r_prefetch;
+}
+
+// The next chunk as list(key, value), in the same form as scan, or
+// NULL once the range is exhausted.  Waits for the prefetch thread if
+// it has not got far enough ahead, checking for interrupts as it does.
+SEXP rleveldb_prefetch_next(SEXP r_prefetch, SEXP r_as_raw) {
+  rleveldb_prefetch *prefetch = rleveldb_get_prefetch(r_prefetch, true);
+  return_as as_raw = to_return_as(r_as_raw);
+  const prefetch_chunk *chunk = NULL;
+  prefetch_state state;
+  while ((state = prefetch_next(prefetch, 0.1, &chunk)) == PREFETCH_TIMEOUT) {
+    R_CheckUserInterrupt();
+  }
+  if (state == PREFETCH_DONE) {
+    const char *err = prefetch_error(prefetch);
+    if (err != NULL) {
+      Rf_error("Prefetch failed: %s", err);
+    }
+    return R_NilValue;
+  }
+
+  rleveldb_stats *stats = rleveldb_get_stats(R_ExternalPtrTag(r_prefetch));
+  stats->keys_scanned += chunk->n;
+  stats->keys_returned += chunk->n;
+
+  SEXP ret = PROTECT(allocVector(VECSXP, 2));
+  const size_t n = chunk->n;
+  const char *src[] = {chunk->key_data, chunk->value_data};
+  const double *src_offset[] = {chunk->key_offset, chunk->value_offset};
+  for (int i = 0; i < 2; ++i) {
+    char *data;
+    double *offset;
+    size_t bytes = (size_t) src_offset[i][n];
+    SEXP el = PROTECT(packed_alloc(n, bytes, &data, &offset));
+    if (bytes > 0) {
+      memcpy(data, src[i], bytes);
+    }
+    memcpy(offset, src_offset[i], (n + 1) * sizeof(double));
+    SET_VECTOR_ELT(ret, i, as_raw == AS_RAW ? el : packed_to_list(el, as_raw));
+    UNPROTECT(1);
+  }
+  SEXP nms = PROTECT(allocVector(STRSXP, 2));
+  SET_STRING_ELT(nms, 0, mkChar("key"));
+  SET_STRING_ELT(nms, 1, mkChar("value"));
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return ret;
+}
+
+SEXP rleveldb_prefetch_close(SEXP r_prefetch, SEXP r_error_if_closed) {
+  rleveldb_prefetch *prefetch =
+    rleveldb_get_prefetch(r_prefetch, scalar_logical(r_error_if_closed));
+  if (prefetch != NULL) {
+    prefetch_close(prefetch);
+    R_ClearExternalPtr(r_prefetch);
+  }
+  return ScalarLogical(prefetch != NULL);
+}
+
 // Iterators
 SEXP rleveldb_iter_create(SEXP r_db, SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
@@ -485,6 +1288,17 @@ SEXP rleveldb_iter_value(SEXP r_it, SEXP r_as_raw, SEXP r_error_if_invalid) {
   return raw_string_to_sexp(data, len, as_raw);
 }
 
+// Read up to n entries starting at the current position, leaving
+// the iterator at the first entry not returned (or invalid if the
+// end was reached).  Returns the same structure as scan().
+SEXP rleveldb_iter_next_n(SEXP r_it, SEXP r_n, SEXP r_as_raw) {
+  return rleveldb_iter_step_n(r_it, r_n, r_as_raw, true);
+}
+
+SEXP rleveldb_iter_prev_n(SEXP r_it, SEXP r_n, SEXP r_as_raw) {
+  return rleveldb_iter_step_n(r_it, r_n, r_as_raw, false);
+}
+
 // Snapshots
 SEXP rleveldb_snapshot_create(SEXP r_db) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
@@ -498,11 +1312,13 @@ SEXP rleveldb_snapshot_create(SEXP r_db) {
 
 // Batch
 SEXP rleveldb_writebatch_create() {
+  SEXP r_count = PROTECT(allocVector(RAWSXP, sizeof(writebatch_count)));
+  memset(RAW(r_count), 0, sizeof(writebatch_count));
   leveldb_writebatch_t *writebatch = leveldb_writebatch_create();
   SEXP r_writebatch =
-    PROTECT(R_MakeExternalPtr((void*) writebatch, R_NilValue, R_NilValue));
+    PROTECT(R_MakeExternalPtr((void*) writebatch, r_count, R_NilValue));
   R_RegisterCFinalizer(r_writebatch, rleveldb_writebatch_finalize);
-  UNPROTECT(1);
+  UNPROTECT(2);
   return r_writebatch;
 }
 
@@ -521,6 +1337,8 @@ SEXP rleveldb_writebatch_clear(SEXP r_writebatch) {
   leveldb_writebatch_t *writebatch =
     rleveldb_get_writebatch(r_writebatch, true);
   leveldb_writebatch_clear(writebatch);
+  memset(rleveldb_get_writebatch_count(r_writebatch), 0,
+         sizeof(writebatch_count));
   return R_NilValue;
 }
 
@@ -531,30 +1349,22 @@ SEXP rleveldb_writebatch_put(SEXP r_writebatch, SEXP r_key, SEXP r_value) {
   size_t
     key_len = get_key(r_key, &key_data),
     value_len = get_value(r_value, &value_data);
-  leveldb_writebatch_put(writebatch, key_data, key_len, value_data, value_len);
+  writebatch_put(writebatch, rleveldb_get_writebatch_count(r_writebatch),
+                 key_data, key_len, value_data, value_len);
   return R_NilValue;
 }
 
 SEXP rleveldb_writebatch_mput(SEXP r_writebatch, SEXP r_key, SEXP r_value) {
   leveldb_writebatch_t *writebatch =
     rleveldb_get_writebatch(r_writebatch, true);
-  const char **key_data = NULL;
-  size_t *key_len = NULL;
+  const char **key_data = NULL, **value_data = NULL;
+  size_t *key_len = NULL, *value_len = NULL;
   size_t num_key = get_keys(r_key, &key_data, &key_len);
-
-  const bool value_is_string = TYPEOF(r_value) == STRSXP;
-  if (!value_is_string && TYPEOF(r_value) != VECSXP) {
-    Rf_error("Expected a character vector or list for 'value'");
-  }
-  if ((size_t)length(r_value) != num_key) {
-    Rf_error("Expected %d values but recieved %d", num_key, length(r_value));
-  }
+  get_values(r_value, num_key, &value_data, &value_len);
+  writebatch_count *count = rleveldb_get_writebatch_count(r_writebatch);
   for (size_t i = 0; i < num_key; ++i) {
-    const char *value_data;
-    SEXP el = value_is_string ? STRING_ELT(r_value, i) : VECTOR_ELT(r_value, i);
-    size_t value_len = get_value(el, &value_data);
-    leveldb_writebatch_put(writebatch, key_data[i], key_len[i],
-                           value_data, value_len);
+    writebatch_put(writebatch, count, key_data[i], key_len[i],
+                   value_data[i], value_len[i]);
   }
 
   return R_NilValue;
@@ -565,20 +1375,61 @@ SEXP rleveldb_writebatch_delete(SEXP r_writebatch, SEXP r_key) {
     rleveldb_get_writebatch(r_writebatch, true);
   const char *key_data = NULL;
   size_t key_len = get_key(r_key, &key_data);
-  leveldb_writebatch_delete(writebatch, key_data, key_len);
+  writebatch_delete(writebatch, rleveldb_get_writebatch_count(r_writebatch),
+                    key_data, key_len);
   return R_NilValue;
 }
 
-// NOTE: arguments 2 & 3 transposed with respect to leveldb API
-SEXP rleveldb_write(SEXP r_db, SEXP r_writebatch, SEXP r_writeoptions) {
-  leveldb_t *db = rleveldb_get_db(r_db, true);
-  leveldb_writeoptions_t *writeoptions =
-    rleveldb_get_writeoptions(r_writeoptions, true);
+SEXP rleveldb_writebatch_mdelete(SEXP r_writebatch, SEXP r_key) {
   leveldb_writebatch_t *writebatch =
     rleveldb_get_writebatch(r_writebatch, true);
-  char *err = NULL;
-  leveldb_write(db, writeoptions, writebatch, &err);
-  rleveldb_handle_error(err);
+  const char **key_data = NULL;
+  size_t *key_len = NULL;
+  size_t num_key = get_keys(r_key, &key_data, &key_len);
+  writebatch_count *count = rleveldb_get_writebatch_count(r_writebatch);
+  for (size_t i = 0; i < num_key; ++i) {
+    writebatch_delete(writebatch, count, key_data[i], key_len[i]);
+  }
+  return R_NilValue;
+}
+
+// NOTE: arguments 2 & 3 transposed with respect to leveldb API
+//
+// A write is atomic, so can't be cancelled once started; an interrupt
+// only takes effect once it has finished.
+SEXP rleveldb_write(SEXP r_db, SEXP r_writebatch, SEXP r_progress,
+                    SEXP r_writeoptions) {
+  write_task data;
+  data.db = rleveldb_get_db(r_db, true);
+  data.writeoptions = rleveldb_get_writeoptions(r_writeoptions, true);
+  data.writebatch = rleveldb_get_writebatch(r_writebatch, true);
+  data.err = NULL;
+  task_check_progress(r_progress);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  data.count = *rleveldb_get_writebatch_count(r_writebatch);
+  if (data.count.reserved > 0 && rleveldb_reserved(r_db)) {
+    Rf_error("Keys starting with a zero byte are reserved for namespaces");
+  }
+  double start = stats_now();
+  task_status status = TASK_DONE;
+  if (data.count.bytes < WRITE_INLINE_BYTES && r_progress == R_NilValue) {
+    leveldb_write(data.db, data.writeoptions, data.writebatch, &data.err);
+  } else {
+    status = task_run(write_task_work, &data, r_progress);
+  }
+  bool completed = data.err == NULL;
+  if (completed) {
+    stats_latency(stats, STATS_OP_WRITE, start);
+    stats_write(stats, data.count.puts, data.count.deletes,
+                data.count.bytes);
+  }
+  if (status != TASK_DONE) {
+    if (!completed) {
+      leveldb_free(data.err);
+    }
+    task_error(status, "write", completed);
+  }
+  rleveldb_handle_error(data.err);
   return R_NilValue;
 }
 
@@ -599,25 +1450,182 @@ SEXP rleveldb_approximate_sizes(SEXP r_db, SEXP r_start_key, SEXP r_limit_key) {
                             start_key, start_key_len,
                             limit_key, limit_key_len,
                             sizes);
-  SEXP ret = PROTECT(allocVector(INTSXP, num_start));
-  int *isizes = INTEGER(ret);
+  // Returned as double, which is exact up to 2^53 bytes (an int
+  // would overflow at 2GB)
+  SEXP ret = PROTECT(allocVector(REALSXP, num_start));
+  double *dsizes = REAL(ret);
   for (size_t i = 0; i < num_start; ++i) {
-    isizes[i] = sizes[i];
+    dsizes[i] = (double) sizes[i];
   }
   UNPROTECT(1);
   return ret;
 }
 
-SEXP rleveldb_compact_range(SEXP r_db, SEXP r_start_key, SEXP r_limit_key) {
+// Split a range into (up to) n_buckets intervals of the key space and
+// estimate the size on disk of each, as list(start, end, size).
+// Bucket i covers [start[i], end[i]), except that the last bucket
+// also includes its end (the last key in the range).  Split keys are
+// spaced evenly between the first and last keys (see partition_keys)
+// so there may be fewer buckets than requested if these are close.
+// Like approximate_sizes, data that is only in the memtable is not
+// counted.  This needs the bytewise comparator.
+SEXP rleveldb_size_histogram(SEXP r_db, SEXP r_n_buckets,
+                             SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                             SEXP r_as_raw) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  size_t n_buckets = scalar_size(r_n_buckets);
+  if (n_buckets == 0) {
+    Rf_error("n_buckets must be at least 1");
+  }
+  if (!comparator_is_bytewise(rleveldb_get_comparator(r_db))) {
+    Rf_error("size_histogram requires the bytewise comparator");
+  }
+  rleveldb_range range;
+  get_range(r_starts_with, r_start, r_end, R_NilValue,
+            rleveldb_get_comparator(r_db), &range);
+  return_as as_raw = to_return_as(r_as_raw);
+
+  const char **bounds = NULL;
+  size_t *bounds_len = NULL;
+  size_t k = partition_keys(db, default_readoptions, &range, n_buckets,
+                            &bounds, &bounds_len);
+  uint64_t *sizes = (uint64_t*) R_alloc(k + 1, sizeof(uint64_t));
+  if (k > 0) {
+    leveldb_approximate_sizes(db, k, bounds, bounds_len,
+                              bounds + 1, bounds_len + 1, sizes);
+  }
+
+  SEXPTYPE key_type = as_raw == AS_STRING ? STRSXP : VECSXP;
+  SEXP r_bucket_start = PROTECT(allocVector(key_type, k));
+  SEXP r_bucket_end = PROTECT(allocVector(key_type, k));
+  SEXP r_size = PROTECT(allocVector(REALSXP, k));
+  for (size_t i = 0; i < k; ++i) {
+    if (as_raw == AS_STRING) {
+      SET_STRING_ELT(r_bucket_start, i, mkCharLen(bounds[i], bounds_len[i]));
+      SET_STRING_ELT(r_bucket_end, i,
+                     mkCharLen(bounds[i + 1], bounds_len[i + 1]));
+    } else {
+      SET_VECTOR_ELT(r_bucket_start, i,
+                     raw_string_to_sexp(bounds[i], bounds_len[i], as_raw));
+      SET_VECTOR_ELT(r_bucket_end, i,
+                     raw_string_to_sexp(bounds[i + 1], bounds_len[i + 1],
+                                        as_raw));
+    }
+    REAL(r_size)[i] = (double) sizes[i];
+  }
+
+  SEXP ret = PROTECT(allocVector(VECSXP, 3));
+  SET_VECTOR_ELT(ret, 0, r_bucket_start);
+  SET_VECTOR_ELT(ret, 1, r_bucket_end);
+  SET_VECTOR_ELT(ret, 2, r_size);
+  SEXP nms = PROTECT(allocVector(STRSXP, 3));
+  SET_STRING_ELT(nms, 0, mkChar("start"));
+  SET_STRING_ELT(nms, 1, mkChar("end"));
+  SET_STRING_ELT(nms, 2, mkChar("size"));
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(5);
+  return ret;
+}
+
+SEXP rleveldb_compact_range(SEXP r_db, SEXP r_start_key, SEXP r_limit_key,
+                            SEXP r_progress) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
   const char *start_key = NULL, *limit_key = NULL;
   size_t
     start_key_len = get_key(r_start_key, &start_key),
     limit_key_len = get_key(r_limit_key, &limit_key);
-  leveldb_compact_range(db, start_key, start_key_len, limit_key, limit_key_len);
+
+  // The pieces run from the start key to the limit key (rather than
+  // the first and last keys present) so that deleted entries at the
+  // ends are compacted too.
+  rleveldb_range range = {NULL, 0, start_key, start_key_len,
+                          limit_key, limit_key_len, RANGE_NO_LIMIT, 0,
+                          rleveldb_get_comparator(r_db), false};
+  compact_task data;
+  data.db = db;
+  data.n = partition_keys(db, default_readoptions, &range, COMPACT_PIECES,
+                          &data.bounds, &data.bounds_len);
+  if (data.n == 0) {
+    data.n = 1;
+    data.bounds = (const char**) R_alloc(2, sizeof(const char*));
+    data.bounds_len = (size_t*) R_alloc(2, sizeof(size_t));
+  }
+  data.bounds[0] = start_key;
+  data.bounds_len[0] = start_key_len;
+  data.bounds[data.n] = limit_key;
+  data.bounds_len[data.n] = limit_key_len;
+  data.sizes = (uint64_t*) R_alloc(data.n, sizeof(uint64_t));
+  leveldb_approximate_sizes(db, data.n, data.bounds, data.bounds_len,
+                            data.bounds + 1, data.bounds_len + 1, data.sizes);
+  data.done = 0;
+
+  task_status status = task_run(compact_task_work, &data, r_progress);
+  if (status != TASK_DONE) {
+    task_error(status, "compact_range", data.done == data.n);
+  }
   return R_NilValue;
 }
 
+// Envs
+SEXP rleveldb_env_create(SEXP r_type, SEXP r_rate_limit) {
+  const char *type = scalar_character(r_type);
+  bool memory;
+  if (strcmp(type, "default") == 0) {
+    memory = false;
+  } else if (strcmp(type, "memory") == 0) {
+    memory = true;
+    if (!env_memory_available()) {
+      Rf_error("The 'memory' env is not available: this leveldb was "
+               "installed without NewMemEnv (libmemenv)");
+    }
+  } else {
+    Rf_error("Invalid value for 'type': expected 'default' or 'memory'");
+  }
+  double rate_limit =
+    r_rate_limit == R_NilValue ? 0 : scalar_size(r_rate_limit);
+  rleveldb_env *env = env_create(memory, rate_limit);
+  if (env == NULL) {
+    Rf_error("Could not create env");
+  }
+  return shared_create(env, env_destroy, ENV_TYPE);
+}
+
+SEXP rleveldb_env_stats(SEXP r_env, SEXP r_reset) {
+  rleveldb_env *env = (rleveldb_env*) shared_get(r_env, ENV_TYPE);
+  bool reset = scalar_logical(r_reset);
+  env_stats stats;
+  env_get_stats(env, reset, &stats);
+  const double values[] = {stats.files_opened, stats.reads, stats.bytes_read,
+                           stats.writes, stats.bytes_written,
+                           stats.throttled};
+  const char *nms_str[] = {"files_opened", "reads", "bytes_read", "writes",
+                           "bytes_written", "throttled"};
+  SEXP ret = PROTECT(allocVector(REALSXP, ENV_STATS_LENGTH));
+  SEXP nms = PROTECT(allocVector(STRSXP, ENV_STATS_LENGTH));
+  for (size_t i = 0; i < ENV_STATS_LENGTH; ++i) {
+    REAL(ret)[i] = values[i];
+    SET_STRING_ELT(nms, i, mkChar(nms_str[i]));
+  }
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return ret;
+}
+
+// Caches and filter policies
+SEXP rleveldb_cache_create(SEXP r_capacity) {
+  size_t capacity = scalar_size(r_capacity);
+  leveldb_cache_t *cache = leveldb_cache_create_lru(capacity);
+  return shared_create(cache, rleveldb_cache_destroy, CACHE_TYPE);
+}
+
+SEXP rleveldb_bloom_create(SEXP r_bits_per_key) {
+  size_t bits_per_key = scalar_size(r_bits_per_key);
+  leveldb_filterpolicy_t *filterpolicy =
+    leveldb_filterpolicy_create_bloom(bits_per_key);
+  return shared_create(filterpolicy, rleveldb_filterpolicy_destroy,
+                       FILTERPOLICY_TYPE);
+}
+
 // Options
 SEXP rleveldb_readoptions(SEXP r_verify_checksums, SEXP r_fill_cache,
                           SEXP r_snapshot) {
@@ -659,59 +1667,266 @@ SEXP rleveldb_writeoptions(SEXP r_sync) {
 
 // Built on top of the leveldb api:
 
-// TODO: at the moment this works with two passes; one computes the
-// number of keys and the other collects the keys.  That's not a bad
-// call, really, but it would be nice to be able to *collect* things.
-// To do that efficiently we need a growing data structure.  It's
-// possible that pairlists may accomplish that fairly effectively.
-// This is going to be needed for a "match pattern" find function,
-// though the bigger hurdle is going to be doing any sort of actual
-// pattern matching aside from "starts with"
-//
-// In any case this would be nice to rework to use pairlists as I
-// think that would be a nice solution and not too hard to implement.
-SEXP rleveldb_keys(SEXP r_db, SEXP r_starts_with, SEXP r_as_raw,
-                   SEXP r_readoptions) {
+// Keys are collected in a single pass over the range and only
+// converted into R objects once the iterator has been released, so
+// the number of keys and the keys themselves always agree (even
+// without a snapshot) and the database is only read once.  Past the
+// first KEYS_INLINE keys, the pass continues on a worker thread so
+// that it can be interrupted.
+SEXP rleveldb_keys(SEXP r_db, SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                   SEXP r_limit, SEXP r_as_raw, SEXP r_filter,
+                   SEXP r_progress, SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
   return_as as_raw = to_return_as(r_as_raw);
+  rleveldb_filter *filter = rleveldb_get_filter(r_filter);
   leveldb_readoptions_t *readoptions =
     rleveldb_get_readoptions(r_readoptions, true);
-  bool as_string = as_raw == AS_STRING;
-  const char *starts_with = NULL;
-  const size_t starts_with_len = get_starts_with(r_starts_with, &starts_with);
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, r_limit, &range);
+  return keys_range(db, &range, filter, as_raw, r_progress, readoptions,
+                    rleveldb_get_stats(r_db));
+}
+
+static SEXP keys_range(leveldb_t *db, const rleveldb_range *range,
+                       const rleveldb_filter *filter, return_as as_raw,
+                       SEXP r_progress, leveldb_readoptions_t *readoptions,
+                       rleveldb_stats *stats) {
+  SEXP r_data = PROTECT(R_MakeExternalPtr(NULL, R_NilValue, R_NilValue));
+  R_RegisterCFinalizer(r_data, keys_task_release);
+  keys_task *data = (keys_task*) calloc(1, sizeof(keys_task));
+  if (data == NULL) {
+    Rf_error("Could not allocate memory for keys");
+  }
+  R_SetExternalPtrAddr(r_data, data);
+  data->db = db;
+  data->filter = filter;
+  data->range = *range;
+  collector_init_native(&data->keys);
+  task_check_progress(r_progress);
+
+  // NOTE: leak danger on throw, so nothing may throw until the
+  // iterator has been destroyed (by the end of task_run)
+  data->it = leveldb_create_iterator(db, readoptions);
+  range_seek(data->it, &data->range);
+  task_status status = TASK_DONE;
+  size_t budget = r_progress == R_NilValue ? KEYS_INLINE : 0;
+  if (keys_task_step(data, NULL, budget)) {
+    leveldb_iter_destroy(data->it);
+    data->it = NULL;
+  } else {
+    status = task_run(keys_task_work, data, r_progress);
+  }
+  if (status != TASK_DONE) {
+    keys_task_release(r_data);
+    task_error(status, "keys", false);
+  }
+  if (data->keys.failed) {
+    keys_task_release(r_data);
+    Rf_error("Could not allocate memory for keys");
+  }
+  stats->keys_scanned += data->scanned;
+  stats->keys_returned += data->keys.n;
 
-  size_t n = rleveldb_get_keys_len(db, starts_with, starts_with_len,
-                                   readoptions);
-  SEXP ret = PROTECT(allocVector(as_string ? STRSXP : VECSXP, n));
+  SEXP ret = PROTECT(collector_finalize(&data->keys, as_raw));
+  keys_task_release(r_data);
+  UNPROTECT(2);
+  return ret;
+}
 
+// Bulk export of a range: keys and values are collected together in
+// one pass and returned as a list with elements 'key' and 'value'.
+// With as_raw = TRUE each element is a "packed" object (one raw
+// vector plus offsets) rather than a list of raw vectors, which
+// avoids allocating an R object per row.
+SEXP rleveldb_scan(SEXP r_db, SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                   SEXP r_limit, SEXP r_as_raw, SEXP r_filter,
+                   SEXP r_readoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  return_as as_raw = to_return_as(r_as_raw);
+  rleveldb_filter *filter = rleveldb_get_filter(r_filter);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, r_limit, &range);
+  return scan_range(db, &range, filter, as_raw, readoptions,
+                    rleveldb_get_stats(r_db));
+}
+
+static SEXP scan_range(leveldb_t *db, const rleveldb_range *range,
+                       const rleveldb_filter *filter, return_as as_raw,
+                       leveldb_readoptions_t *readoptions,
+                       rleveldb_stats *stats) {
+  collector keys, values;
+  collector_init(&keys);
+  collector_init(&values);
+  size_t scanned = 0;
   leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
-  leveldb_iter_seek_to_first(it);
-  size_t key_len;
-  for (size_t i = 0; i < n; leveldb_iter_next(it)) {
-    if (iter_key_starts_with(it, starts_with, starts_with_len)) {
-      const char *key_data = leveldb_iter_key(it, &key_len);
-      if (as_string) {
-        SET_STRING_ELT(ret, i, mkCharLen(key_data, key_len));
-      } else {
-        SET_VECTOR_ELT(ret, i, raw_string_to_sexp(key_data, key_len, as_raw));
-      }
-      ++i;
+  for (range_seek(it, range);
+       keys.n < range->limit && range_valid(it, range);
+       leveldb_iter_next(it)) {
+    ++scanned;
+    if (!filter_match(filter, it)) {
+      continue;
     }
+    size_t key_len, value_len;
+    const char *key_data = leveldb_iter_key(it, &key_len);
+    const char *value_data = leveldb_iter_value(it, &value_len);
+    collector_push(&keys, key_data + range->strip, key_len - range->strip);
+    collector_push(&values, value_data, value_len);
   }
+  stats_scan(stats, it, scanned, keys.n, range->limit);
   leveldb_iter_destroy(it);
 
-  UNPROTECT(1);
+  return rleveldb_scan_result(&keys, &values, as_raw);
+}
+
+// Scan a range in parallel: the range is split into nthreads parts of
+// similar size on disk (see partition_range), each of which is read
+// by its own native iterator from a shared snapshot.  The results are
+// merged in key order, so 'scan' and 'keys' return the same as
+// rleveldb_scan and rleveldb_keys, while 'count' returns the number
+// of keys and the total size of the keys and values.  If readoptions
+// does not include a snapshot, one is taken for the duration of the
+// scan.
+SEXP rleveldb_parallel_scan(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                            SEXP r_end, SEXP r_what, SEXP r_nthreads,
+                            SEXP r_as_raw, SEXP r_filter,
+                            SEXP r_readoptions) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  rleveldb_filter *filter = rleveldb_get_filter(r_filter);
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, R_NilValue, &range);
+  const char *what_str = scalar_character(r_what);
+  parallel_scan_what what;
+  if (strcmp(what_str, "scan") == 0) {
+    what = PARALLEL_SCAN_SCAN;
+  } else if (strcmp(what_str, "keys") == 0) {
+    what = PARALLEL_SCAN_KEYS;
+  } else if (strcmp(what_str, "count") == 0) {
+    what = PARALLEL_SCAN_COUNT;
+  } else {
+    Rf_error("Invalid value for 'what': expected 'scan', 'keys' or 'count'");
+  }
+  size_t nthreads = scalar_size(r_nthreads);
+  if (nthreads == 0) {
+    nthreads = 1;
+  }
+  return_as as_raw = to_return_as(r_as_raw);
+
+  // The options are rebuilt (from the tag that records them) with a
+  // snapshot added, if needed
+  rleveldb_get_readoptions(r_readoptions, true);
+  SEXP r_options = r_readoptions == R_NilValue ?
+    R_NilValue : R_ExternalPtrTag(r_readoptions);
+  bool take_snapshot =
+    r_options == R_NilValue || VECTOR_ELT(r_options, 2) == R_NilValue;
+  SEXP r_snapshot =
+    PROTECT(take_snapshot ? rleveldb_snapshot_create(r_db) : R_NilValue);
+  if (take_snapshot) {
+    r_readoptions = r_options == R_NilValue ?
+      rleveldb_readoptions(R_NilValue, R_NilValue, r_snapshot) :
+      rleveldb_readoptions(VECTOR_ELT(r_options, 0),
+                           VECTOR_ELT(r_options, 1), r_snapshot);
+  }
+  PROTECT(r_readoptions);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(r_readoptions, true);
+
+  rleveldb_range *ranges =
+    (rleveldb_range*) R_alloc(nthreads, sizeof(rleveldb_range));
+  size_t n_parts = partition_range(db, readoptions, &range, nthreads, ranges);
+
+  // The parts are owned by an external pointer so that the native
+  // collectors are released even if converting them throws.
+  SEXP r_parts = PROTECT(R_MakeExternalPtr(NULL, R_NilValue, R_NilValue));
+  R_RegisterCFinalizer(r_parts, parallel_scan_release);
+  parallel_scan_parts *all_parts = (parallel_scan_parts*)
+    calloc(1, sizeof(parallel_scan_parts) +
+           (n_parts + 1) * sizeof(parallel_scan_part));
+  if (all_parts == NULL) {
+    Rf_error("Could not allocate memory for parallel scan");
+  }
+  all_parts->n = n_parts;
+  all_parts->part = (parallel_scan_part*) (all_parts + 1);
+  R_SetExternalPtrAddr(r_parts, all_parts);
+  parallel_scan_part *parts = all_parts->part;
+  for (size_t i = 0; i <= n_parts; ++i) {
+    parts[i].range = i < n_parts ? ranges[i] : range;
+    parts[i].range.limit = RANGE_NO_LIMIT;
+    collector_init_native(&parts[i].keys);
+    collector_init_native(&parts[i].values);
+  }
+
+  parallel_scan_data data;
+  data.db = db;
+  data.readoptions = readoptions;
+  data.filter = filter;
+  data.what = what;
+  data.parts = parts;
+  parallel_for(n_parts, n_parts, parallel_scan_worker, &data);
+  if (take_snapshot) {
+    rleveldb_snapshot_finalize(r_snapshot);
+  }
+
+  // Merge everything into the spare part at the end, which keeps the
+  // key order as the parts are contiguous.
+  parallel_scan_part *all = parts + n_parts;
+  char *err = NULL;
+  for (size_t i = 0; i < n_parts; ++i) {
+    if (err == NULL) {
+      err = parts[i].err;
+      parts[i].err = NULL;
+    }
+    all->scanned += parts[i].scanned;
+    all->n += parts[i].n;
+    all->key_bytes += parts[i].key_bytes;
+    all->value_bytes += parts[i].value_bytes;
+    collector_append(&all->keys, &parts[i].keys);
+    collector_append(&all->values, &parts[i].values);
+  }
+  if (err != NULL || all->keys.failed || all->values.failed) {
+    parallel_scan_release(r_parts);
+    rleveldb_handle_error(err);
+    Rf_error("Could not allocate memory for parallel scan");
+  }
+
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  stats->keys_scanned += all->scanned;
+  stats->keys_returned += all->n;
+
+  SEXP ret;
+  if (what == PARALLEL_SCAN_SCAN) {
+    ret = PROTECT(rleveldb_scan_result(&all->keys, &all->values, as_raw));
+  } else if (what == PARALLEL_SCAN_KEYS) {
+    ret = PROTECT(collector_finalize(&all->keys, as_raw));
+  } else {
+    const char *names[] = {"keys", "key_bytes", "value_bytes"};
+    const double values[] = {all->n, all->key_bytes, all->value_bytes};
+    ret = PROTECT(allocVector(REALSXP, 3));
+    SEXP nms = PROTECT(allocVector(STRSXP, 3));
+    for (int i = 0; i < 3; ++i) {
+      REAL(ret)[i] = values[i];
+      SET_STRING_ELT(nms, i, mkChar(names[i]));
+    }
+    setAttrib(ret, R_NamesSymbol, nms);
+    UNPROTECT(1);
+  }
+  parallel_scan_release(r_parts);
+  UNPROTECT(4);
   return ret;
 }
 
-SEXP rleveldb_keys_len(SEXP r_db, SEXP r_starts_with, SEXP r_readoptions) {
+SEXP rleveldb_keys_len(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                       SEXP r_end, SEXP r_limit, SEXP r_filter,
+                       SEXP r_readoptions) {
   leveldb_t *db = rleveldb_get_db(r_db, true);
+  rleveldb_filter *filter = rleveldb_get_filter(r_filter);
   leveldb_readoptions_t *readoptions =
     rleveldb_get_readoptions(r_readoptions, true);
-  const char *starts_with = NULL;
-  const size_t starts_with_len = get_starts_with(r_starts_with, &starts_with);
-  return ScalarInteger(rleveldb_get_keys_len(db, starts_with,
-                                             starts_with_len, readoptions));
+  rleveldb_range range;
+  get_db_range(r_db, r_starts_with, r_start, r_end, r_limit, &range);
+  return ScalarInteger(rleveldb_get_keys_len(db, &range, filter, readoptions,
+                                             rleveldb_get_stats(r_db)));
 }
 
 SEXP rleveldb_exists(SEXP r_db, SEXP r_key, SEXP r_readoptions) {
@@ -723,11 +1938,362 @@ SEXP rleveldb_exists(SEXP r_db, SEXP r_key, SEXP r_readoptions) {
   size_t num_key = get_keys(r_key, &key_data, &key_len);
   SEXP r_found = PROTECT(allocVector(LGLSXP, num_key));
   int *found = INTEGER(r_found);
-  rleveldb_get_exists(db, num_key, key_data, key_len, readoptions, found);
+  rleveldb_get_exists(db, num_key, key_data, key_len, readoptions, found,
+                      rleveldb_get_stats(r_db));
   UNPROTECT(1);
   return r_found;
 }
 
+// Namespaces (see namespace.h).  An operation on a namespace is the
+// same operation on the connection with the keys moved into the
+// namespace; the change in the connection's counters over the call is
+// added to the namespace's counters (see namespace_run).
+SEXP rleveldb_namespace(SEXP r_db, SEXP r_name, SEXP r_create) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  const char *name = scalar_character(r_name);
+  bool create = scalar_logical(r_create);
+  if (name[0] == '\0') {
+    Rf_error("Namespace names must not be empty");
+  }
+
+  SEXP db_tag = rleveldb_tag(r_db);
+  for (SEXP r_namespaces = VECTOR_ELT(db_tag, TAG_NAMESPACES);
+       r_namespaces != R_NilValue;
+       r_namespaces = CDR(r_namespaces)) {
+    SEXP r_ns = CAR(r_namespaces);
+    if (strcmp(CHAR(STRING_ELT(VECTOR_ELT(r_ns, NS_NAME), 0)), name) == 0) {
+      return r_ns;
+    }
+  }
+
+  size_t key_len;
+  const char *key = namespace_key(0, name, strlen(name), &key_len);
+  char *err = NULL;
+  size_t read_len;
+  char *read = leveldb_get(db, default_readoptions, key, key_len,
+                           &read_len, &err);
+  rleveldb_handle_error(err);
+  size_t id = 0;
+  if (read != NULL) {
+    id = namespace_id(read, read_len);
+    leveldb_free(read);
+    if (id == 0) {
+      Rf_error("Invalid registry entry for namespace '%s'", name);
+    }
+  } else if (!create) {
+    Rf_error("Namespace '%s' does not exist", name);
+  } else {
+    id = namespace_next_id(db, rleveldb_get_comparator(r_db));
+    if (id > NAMESPACE_MAX_ID) {
+      Rf_error("Too many namespaces (the maximum is %d)", NAMESPACE_MAX_ID);
+    }
+    const char value[] = {(char) (id >> 8), (char) (id & 0xff)};
+    leveldb_put(db, default_writeoptions, key, key_len, value, 2, &err);
+    rleveldb_handle_error(err);
+  }
+  namespace_reserve(r_db);
+
+  SEXP r_ns = PROTECT(namespace_create(r_db, r_name, id));
+  SEXP r_namespaces = VECTOR_ELT(db_tag, TAG_NAMESPACES);
+  SET_VECTOR_ELT(db_tag, TAG_NAMESPACES, CONS(r_ns, r_namespaces));
+  UNPROTECT(1);
+  return r_ns;
+}
+
+// All namespaces in the registry, with their approximate size on disk
+SEXP rleveldb_namespace_list(SEXP r_db) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  const rleveldb_comparator *comparator = rleveldb_get_comparator(r_db);
+  char registry[NAMESPACE_PREFIX_LEN];
+  namespace_prefix(0, registry);
+  rleveldb_range range = {registry, NAMESPACE_PREFIX_LEN, NULL, 0, NULL, 0,
+                          RANGE_NO_LIMIT, NAMESPACE_PREFIX_LEN, comparator,
+                          false};
+
+  // Nothing may throw while the iterator is live, so the ids are
+  // collected as bytes and decoded afterwards
+  collector names, values;
+  collector_init(&names);
+  collector_init(&values);
+  leveldb_iterator_t *it = leveldb_create_iterator(db, default_readoptions);
+  for (range_seek(it, &range); range_valid(it, &range);
+       leveldb_iter_next(it)) {
+    size_t key_len, value_len;
+    const char *key = leveldb_iter_key(it, &key_len);
+    if (key_len == range.strip) {
+      continue; // the entry marking the database as using namespaces
+    }
+    const char *value = leveldb_iter_value(it, &value_len);
+    collector_push(&names, key + range.strip, key_len - range.strip);
+    collector_push(&values, value, value_len);
+  }
+  leveldb_iter_destroy(it);
+
+  size_t n = names.n;
+  SEXP r_name = PROTECT(collector_finalize(&names, AS_STRING));
+  SEXP r_values = PROTECT(collector_finalize_packed(&values));
+  const char *value_data;
+  const double *value_offset;
+  get_packed(r_values, &value_data, &value_offset);
+  SEXP r_id = PROTECT(allocVector(INTSXP, n));
+  SEXP r_size = PROTECT(allocVector(REALSXP, n));
+  SEXP r_prefix = PROTECT(allocVector(RAWSXP, NAMESPACE_PREFIX_LEN));
+  for (size_t i = 0; i < n; ++i) {
+    size_t from = value_offset[i], to = value_offset[i + 1];
+    size_t id = namespace_id(value_data + from, to - from);
+    namespace_prefix(id, (char*) RAW(r_prefix));
+    INTEGER(r_id)[i] = id == 0 ? NA_INTEGER : (int) id;
+    REAL(r_size)[i] =
+      id == 0 ? NA_REAL : namespace_size(db, comparator, r_prefix);
+  }
+
+  const char *nms_str[] = {"name", "id", "size"};
+  SEXP ret = PROTECT(allocVector(VECSXP, 3));
+  SEXP nms = PROTECT(allocVector(STRSXP, 3));
+  SET_VECTOR_ELT(ret, 0, r_name);
+  SET_VECTOR_ELT(ret, 1, r_id);
+  SET_VECTOR_ELT(ret, 2, r_size);
+  for (int i = 0; i < 3; ++i) {
+    SET_STRING_ELT(nms, i, mkChar(nms_str[i]));
+  }
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(7);
+  return ret;
+}
+
+SEXP rleveldb_ns_get(SEXP r_ns, SEXP r_key, SEXP r_as_raw,
+                     SEXP r_error_if_missing, SEXP r_readoptions) {
+  SEXP args[] = {r_key, r_as_raw, r_error_if_missing, r_readoptions};
+  return namespace_run(r_ns, ns_get, args);
+}
+
+static SEXP ns_get(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_key = args[0], r_as_raw = args[1], r_error_if_missing = args[2],
+    r_readoptions = args[3];
+  const char *key_data = NULL;
+  get_key(r_key, &key_data);
+  bool error_if_missing = scalar_logical(r_error_if_missing);
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, r_key));
+  SEXP ret = PROTECT(rleveldb_get(r_db, r_ns_key, r_as_raw,
+                                  ScalarLogical(false), ScalarLogical(false),
+                                  r_readoptions));
+  // The error is raised here so that it shows the key without the
+  // prefix
+  if (ret == R_NilValue && error_if_missing) {
+    if (TYPEOF(r_key) == STRSXP) {
+      Rf_error("Key '%s' not found in database", key_data);
+    } else {
+      Rf_error("Key not found in database");
+    }
+  }
+  UNPROTECT(2);
+  return ret;
+}
+
+SEXP rleveldb_ns_mget(SEXP r_ns, SEXP r_key, SEXP r_as_raw,
+                      SEXP r_missing_value, SEXP r_missing_report,
+                      SEXP r_nthreads, SEXP r_sorted, SEXP r_readoptions) {
+  SEXP args[] = {r_key, r_as_raw, r_missing_value, r_missing_report,
+                 r_nthreads, r_sorted, r_readoptions};
+  return namespace_run(r_ns, ns_mget, args);
+}
+
+static SEXP ns_mget(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, args[0]));
+  SEXP ret = rleveldb_mget(r_db, r_ns_key, args[1], args[2], args[3],
+                           args[4], args[5], ScalarLogical(false), args[6]);
+  UNPROTECT(1);
+  return ret;
+}
+
+SEXP rleveldb_ns_put(SEXP r_ns, SEXP r_key, SEXP r_value,
+                     SEXP r_writeoptions) {
+  SEXP args[] = {r_key, r_value, r_writeoptions};
+  return namespace_run(r_ns, ns_put, args);
+}
+
+static SEXP ns_put(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, args[0]));
+  rleveldb_put(r_db, r_ns_key, args[1], args[2]);
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP rleveldb_ns_mput(SEXP r_ns, SEXP r_key, SEXP r_value,
+                      SEXP r_writeoptions) {
+  SEXP args[] = {r_key, r_value, r_writeoptions};
+  return namespace_run(r_ns, ns_mput, args);
+}
+
+static SEXP ns_mput(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, args[0]));
+  rleveldb_mput(r_db, r_ns_key, args[1], args[2]);
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP rleveldb_ns_delete(SEXP r_ns, SEXP r_key, SEXP r_writeoptions) {
+  SEXP args[] = {r_key, r_writeoptions};
+  return namespace_run(r_ns, ns_delete, args);
+}
+
+static SEXP ns_delete(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, args[0]));
+  rleveldb_delete_silent(r_db, r_ns_key, args[1]);
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP rleveldb_ns_exists(SEXP r_ns, SEXP r_key, SEXP r_readoptions) {
+  SEXP args[] = {r_key, r_readoptions};
+  return namespace_run(r_ns, ns_exists, args);
+}
+
+static SEXP ns_exists(SEXP r_db, SEXP r_ns, SEXP *args) {
+  SEXP r_ns_key = PROTECT(namespace_keys(r_ns, args[0]));
+  SEXP ret = rleveldb_exists(r_db, r_ns_key, args[1]);
+  UNPROTECT(1);
+  return ret;
+}
+
+SEXP rleveldb_ns_keys(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                      SEXP r_end, SEXP r_limit, SEXP r_as_raw,
+                      SEXP r_readoptions) {
+  SEXP args[] = {r_starts_with, r_start, r_end, r_limit, r_as_raw,
+                 r_readoptions};
+  return namespace_run(r_ns, ns_keys, args);
+}
+
+static SEXP ns_keys(SEXP r_db, SEXP r_ns, SEXP *args) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  return_as as_raw = to_return_as(args[4]);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(args[5], true);
+  rleveldb_range range;
+  get_range(args[0], args[1], args[2], args[3],
+            rleveldb_get_comparator(r_db), &range);
+  namespace_range(r_ns, &range);
+  return keys_range(db, &range, NULL, as_raw, R_NilValue, readoptions,
+                    rleveldb_get_stats(r_db));
+}
+
+SEXP rleveldb_ns_keys_len(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                          SEXP r_end, SEXP r_limit, SEXP r_readoptions) {
+  SEXP args[] = {r_starts_with, r_start, r_end, r_limit, r_readoptions};
+  return namespace_run(r_ns, ns_keys_len, args);
+}
+
+static SEXP ns_keys_len(SEXP r_db, SEXP r_ns, SEXP *args) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(args[4], true);
+  rleveldb_range range;
+  get_range(args[0], args[1], args[2], args[3],
+            rleveldb_get_comparator(r_db), &range);
+  namespace_range(r_ns, &range);
+  size_t n = rleveldb_get_keys_len(db, &range, NULL, readoptions,
+                                   rleveldb_get_stats(r_db));
+  return ScalarInteger(n);
+}
+
+SEXP rleveldb_ns_scan(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                      SEXP r_end, SEXP r_limit, SEXP r_as_raw,
+                      SEXP r_readoptions) {
+  SEXP args[] = {r_starts_with, r_start, r_end, r_limit, r_as_raw,
+                 r_readoptions};
+  return namespace_run(r_ns, ns_scan, args);
+}
+
+static SEXP ns_scan(SEXP r_db, SEXP r_ns, SEXP *args) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  return_as as_raw = to_return_as(args[4]);
+  leveldb_readoptions_t *readoptions =
+    rleveldb_get_readoptions(args[5], true);
+  rleveldb_range range;
+  get_range(args[0], args[1], args[2], args[3],
+            rleveldb_get_comparator(r_db), &range);
+  namespace_range(r_ns, &range);
+  return scan_range(db, &range, NULL, as_raw, readoptions,
+                    rleveldb_get_stats(r_db));
+}
+
+SEXP rleveldb_ns_delete_range(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                              SEXP r_end, SEXP r_batch_size, SEXP r_compact,
+                              SEXP r_writeoptions) {
+  SEXP args[] = {r_starts_with, r_start, r_end, r_batch_size, r_compact,
+                 r_writeoptions};
+  return namespace_run(r_ns, ns_delete_range, args);
+}
+
+static SEXP ns_delete_range(SEXP r_db, SEXP r_ns, SEXP *args) {
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  rleveldb_range range;
+  get_range(args[0], args[1], args[2], R_NilValue,
+            rleveldb_get_comparator(r_db), &range);
+  namespace_range(r_ns, &range);
+  size_t batch_size = scalar_size(args[3]);
+  if (batch_size == 0) {
+    Rf_error("batch_size must be at least 1");
+  }
+  bool compact = scalar_logical(args[4]);
+  leveldb_writeoptions_t *writeoptions =
+    rleveldb_get_writeoptions(args[5], true);
+  size_t n = delete_range(db, &range, batch_size, compact, writeoptions,
+                          rleveldb_get_stats(r_db));
+  return ScalarReal(n);
+}
+
+SEXP rleveldb_ns_size(SEXP r_ns) {
+  SEXP r_db = namespace_check(r_ns);
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  return ScalarReal(namespace_size(db, rleveldb_get_comparator(r_db),
+                                   VECTOR_ELT(r_ns, NS_PREFIX)));
+}
+
+// The namespace's counters, and the number of keys in it.  There is
+// no running count of keys (a put can't tell whether it adds a key
+// without reading it first) so they are counted here, by a scan that
+// is not itself counted.
+SEXP rleveldb_ns_stats(SEXP r_ns, SEXP r_reset) {
+  SEXP r_db = namespace_check(r_ns);
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  bool reset = scalar_logical(r_reset);
+  rleveldb_range range;
+  get_range(R_NilValue, R_NilValue, R_NilValue, R_NilValue,
+            rleveldb_get_comparator(r_db), &range);
+  namespace_range(r_ns, &range);
+  rleveldb_stats scan_stats;
+  stats_reset(&scan_stats);
+  size_t n = rleveldb_get_keys_len(db, &range, NULL, default_readoptions,
+                                   &scan_stats);
+
+  rleveldb_stats *stats = (rleveldb_stats*) RAW(VECTOR_ELT(r_ns, NS_STATS));
+  SEXP ret = PROTECT(allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(ret, 0, stats_to_sexp(stats));
+  SET_VECTOR_ELT(ret, 1, ScalarReal(n));
+  if (reset) {
+    stats_reset(stats);
+  }
+  UNPROTECT(1);
+  return ret;
+}
+
+// Returns the counters and (optionally) resets them.
+SEXP rleveldb_stats_get(SEXP r_db, SEXP r_reset) {
+  rleveldb_get_db(r_db, true);
+  bool reset = scalar_logical(r_reset);
+  rleveldb_stats *stats = rleveldb_get_stats(r_db);
+  SEXP ret = stats_to_sexp(stats);
+  if (reset) {
+    stats_reset(stats);
+  }
+  return ret;
+}
+
+SEXP rleveldb_unpack(SEXP r_x, SEXP r_as_raw) {
+  return packed_to_list(r_x, to_return_as(r_as_raw));
+}
+
 SEXP rleveldb_version() {
   SEXP ret = PROTECT(allocVector(INTSXP, 2));
   INTEGER(ret)[0] = leveldb_major_version();
@@ -736,15 +2302,139 @@ SEXP rleveldb_version() {
   return ret;
 }
 
+// The clock used for the latency counters, for timing from R at a
+// finer resolution than proc.time() gives
+SEXP rleveldb_clock() {
+  return ScalarReal(stats_now());
+}
+
 // For internal use:
 SEXP rleveldb_tag(SEXP r_db) {
   return R_ExternalPtrTag(r_db);
 }
 
+rleveldb_stats* rleveldb_get_stats(SEXP r_db) {
+  return (rleveldb_stats*) RAW(VECTOR_ELT(rleveldb_tag(r_db), TAG_STATS));
+}
+
+const rleveldb_comparator* rleveldb_get_comparator(SEXP r_db) {
+  SEXP r_type = VECTOR_ELT(rleveldb_tag(r_db), TAG_COMPARATOR);
+  return comparator_get((comparator_type) INTEGER(r_type)[0]);
+}
+
+// Whether plain operations must keep out of the keys reserved for
+// namespaces (see namespace.h)
+static bool rleveldb_reserved(SEXP r_db) {
+  return LOGICAL(VECTOR_ELT(rleveldb_tag(r_db), TAG_RESERVED))[0];
+}
+
+static void check_unreserved(SEXP r_db, size_t num_key,
+                             const char **key_data, const size_t *key_len) {
+  if (!rleveldb_reserved(r_db)) {
+    return;
+  }
+  for (size_t i = 0; i < num_key; ++i) {
+    if (namespace_reserved(key_data[i], key_len[i])) {
+      Rf_error("Keys starting with a zero byte are reserved for namespaces");
+    }
+  }
+}
+
+// get_range for a plain operation, which skips any reserved keys
+static void get_db_range(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                         SEXP r_end, SEXP r_limit, rleveldb_range *range) {
+  get_range(r_starts_with, r_start, r_end, r_limit,
+            rleveldb_get_comparator(r_db), range);
+  range->skip_reserved = rleveldb_reserved(r_db);
+}
+
+// A database uses namespaces once its registry holds the entry with
+// the empty name
+static bool namespace_in_use(leveldb_t *db) {
+  size_t key_len;
+  const char *key = namespace_key(0, "", 0, &key_len);
+  char *err = NULL;
+  size_t read_len;
+  char *read = leveldb_get(db, default_readoptions, key, key_len,
+                           &read_len, &err);
+  rleveldb_handle_error(err);
+  bool found = read != NULL;
+  leveldb_free(read);
+  return found;
+}
+
+static void namespace_reserve(SEXP r_db) {
+  if (rleveldb_reserved(r_db)) {
+    return;
+  }
+  leveldb_t *db = rleveldb_get_db(r_db, true);
+  size_t key_len;
+  const char *key = namespace_key(0, "", 0, &key_len);
+  const char value[] = {0, 0};
+  char *err = NULL;
+  leveldb_put(db, default_writeoptions, key, key_len, value, 2, &err);
+  rleveldb_handle_error(err);
+  LOGICAL(VECTOR_ELT(rleveldb_tag(r_db), TAG_RESERVED))[0] = true;
+}
+
+// A cache (or filter policy) for a database to be opened with: a
+// shared one, one made for it alone from a capacity (or bits per key),
+// or NULL for leveldb's default (8MB of cache and no filter).
+static SEXP get_cache(SEXP r_cache_capacity) {
+  if (r_cache_capacity == R_NilValue) {
+    return R_NilValue;
+  } else if (TYPEOF(r_cache_capacity) == EXTPTRSXP) {
+    shared_get(r_cache_capacity, CACHE_TYPE);
+    return r_cache_capacity;
+  } else {
+    return rleveldb_cache_create(r_cache_capacity);
+  }
+}
+
+static SEXP get_filterpolicy(SEXP r_bloom_filter_bits_per_key) {
+  if (r_bloom_filter_bits_per_key == R_NilValue) {
+    return R_NilValue;
+  } else if (TYPEOF(r_bloom_filter_bits_per_key) == EXTPTRSXP) {
+    shared_get(r_bloom_filter_bits_per_key, FILTERPOLICY_TYPE);
+    return r_bloom_filter_bits_per_key;
+  } else {
+    return rleveldb_bloom_create(r_bloom_filter_bits_per_key);
+  }
+}
+
+// Give back the database's references to shared objects, once it has
+// been closed
+static void release_shared(SEXP tag) {
+  shared_release(VECTOR_ELT(tag, TAG_CACHE));
+  shared_release(VECTOR_ELT(tag, TAG_FILTERPOLICY));
+  shared_release(VECTOR_ELT(tag, TAG_ENV));
+}
+
+// NULL is leveldb's own default Env
+static rleveldb_env* get_env(SEXP r_env) {
+  return r_env == R_NilValue ?
+    NULL : (rleveldb_env*) shared_get(r_env, ENV_TYPE);
+}
+
+// NULL is leveldb's default (bytewise) ordering
+static const rleveldb_comparator* get_comparator(SEXP r_comparator) {
+  if (r_comparator == R_NilValue) {
+    return comparator_get(COMPARATOR_BYTEWISE);
+  }
+  const char *name = scalar_character(r_comparator);
+  const rleveldb_comparator *comparator = comparator_find(name);
+  if (comparator == NULL) {
+    Rf_error("Unknown comparator '%s' (expected one of 'bytewise', "
+             "'reverse', 'natural' or 'uint64')", name);
+  }
+  return comparator;
+}
+
 // For package management:
 void rleveldb_init() {
   default_readoptions = leveldb_readoptions_create();
   default_writeoptions = leveldb_writeoptions_create();
+  comparator_init();
 }
 
 void rleveldb_cleanup() {
@@ -756,11 +2446,32 @@ void rleveldb_cleanup() {
 void rleveldb_finalize(SEXP r_db) {
   leveldb_t* db = rleveldb_get_db(r_db, false);
   if (db != NULL) {
+    // Writers and prefetchers hold on to the db pointer, so must be
+    // stopped first (they are not necessarily finalised before the db)
+    rleveldb_close_writers(r_db);
+    rleveldb_close_prefetchers(r_db);
     leveldb_close(db);
+    release_shared(rleveldb_tag(r_db));
     R_ClearExternalPtr(r_db);
   }
 }
 
+void rleveldb_writer_finalize(SEXP r_writer) {
+  rleveldb_writer *writer = rleveldb_get_writer(r_writer, false);
+  if (writer != NULL) {
+    writer_close(writer);
+    R_ClearExternalPtr(r_writer);
+  }
+}
+
+void rleveldb_prefetch_finalize(SEXP r_prefetch) {
+  rleveldb_prefetch *prefetch = rleveldb_get_prefetch(r_prefetch, false);
+  if (prefetch != NULL) {
+    prefetch_close(prefetch);
+    R_ClearExternalPtr(r_prefetch);
+  }
+}
+
 void rleveldb_iter_finalize(SEXP r_it) {
   leveldb_iterator_t* it = rleveldb_get_iterator(r_it, false);
   if (it != NULL) {
@@ -807,25 +2518,12 @@ void rleveldb_writeoptions_finalize(SEXP r_writeoptions) {
   }
 }
 
-void rleveldb_cache_finalize(SEXP r_cache) {
-  if (TYPEOF(r_cache) == EXTPTRSXP) {
-    leveldb_cache_t* cache = (leveldb_cache_t*) R_ExternalPtrAddr(r_cache);
-    if (cache) {
-      leveldb_cache_destroy(cache);
-      R_ClearExternalPtr(r_cache);
-    }
-  }
+void rleveldb_cache_destroy(void *cache) {
+  leveldb_cache_destroy((leveldb_cache_t*) cache);
 }
 
-void rleveldb_filterpolicy_finalize(SEXP r_filterpolicy) {
-  if (TYPEOF(r_filterpolicy) == EXTPTRSXP) {
-    leveldb_filterpolicy_t* filterpolicy =
-      (leveldb_filterpolicy_t*) R_ExternalPtrAddr(r_filterpolicy);
-    if (filterpolicy) {
-      leveldb_filterpolicy_destroy(filterpolicy);
-      R_ClearExternalPtr(r_filterpolicy);
-    }
-  }
+void rleveldb_filterpolicy_destroy(void *filterpolicy) {
+  leveldb_filterpolicy_destroy((leveldb_filterpolicy_t*) filterpolicy);
 }
 
 leveldb_t* rleveldb_get_db(SEXP r_db, bool closed_error) {
@@ -854,6 +2552,57 @@ leveldb_iterator_t* rleveldb_get_iterator(SEXP r_it, bool closed_error) {
   return (leveldb_iterator_t*) it;
 }
 
+rleveldb_writer* rleveldb_get_writer(SEXP r_writer, bool closed_error) {
+  void *writer = NULL;
+  if (TYPEOF(r_writer) != EXTPTRSXP) {
+    Rf_error("Expected an external pointer");
+  }
+  writer = (rleveldb_writer*) R_ExternalPtrAddr(r_writer);
+  if (!writer && closed_error) {
+    Rf_error("leveldb writer is not open; can't connect");
+  }
+  return (rleveldb_writer*) writer;
+}
+
+void rleveldb_writer_check(rleveldb_writer *writer) {
+  const char *err = writer_error(writer);
+  if (err != NULL) {
+    Rf_error("Asynchronous write failed: %s", err);
+  }
+}
+
+// Called when closing (or finalising) the db.  Outstanding writes are
+// completed but any error is discarded.
+void rleveldb_close_writers(SEXP r_db) {
+  SEXP tag = rleveldb_tag(r_db);
+  for (SEXP r_writers = VECTOR_ELT(tag, TAG_WRITERS);
+       r_writers != R_NilValue; r_writers = CDR(r_writers)) {
+    rleveldb_writer_finalize(CAR(r_writers));
+  }
+  SET_VECTOR_ELT(tag, TAG_WRITERS, R_NilValue);
+}
+
+rleveldb_prefetch* rleveldb_get_prefetch(SEXP r_prefetch, bool closed_error) {
+  void *prefetch = NULL;
+  if (TYPEOF(r_prefetch) != EXTPTRSXP) {
+    Rf_error("Expected an external pointer");
+  }
+  prefetch = (rleveldb_prefetch*) R_ExternalPtrAddr(r_prefetch);
+  if (!prefetch && closed_error) {
+    Rf_error("leveldb prefetcher is not open; can't connect");
+  }
+  return (rleveldb_prefetch*) prefetch;
+}
+
+void rleveldb_close_prefetchers(SEXP r_db) {
+  SEXP tag = rleveldb_tag(r_db);
+  for (SEXP r_prefetchers = VECTOR_ELT(tag, TAG_PREFETCHERS);
+       r_prefetchers != R_NilValue; r_prefetchers = CDR(r_prefetchers)) {
+    rleveldb_prefetch_finalize(CAR(r_prefetchers));
+  }
+  SET_VECTOR_ELT(tag, TAG_PREFETCHERS, R_NilValue);
+}
+
 leveldb_snapshot_t* rleveldb_get_snapshot(SEXP r_snapshot, bool closed_error) {
   void *snapshot = NULL;
   if (TYPEOF(r_snapshot) != EXTPTRSXP) {
@@ -878,6 +2627,31 @@ leveldb_writebatch_t* rleveldb_get_writebatch(SEXP r_writebatch, bool closed_err
   return (leveldb_writebatch_t*) writebatch;
 }
 
+// Only valid once rleveldb_get_writebatch has checked r_writebatch
+static writebatch_count* rleveldb_get_writebatch_count(SEXP r_writebatch) {
+  return (writebatch_count*) RAW(R_ExternalPtrTag(r_writebatch));
+}
+
+static void writebatch_put(leveldb_writebatch_t *writebatch,
+                           writebatch_count *count,
+                           const char *key_data, size_t key_len,
+                           const char *value_data, size_t value_len) {
+  leveldb_writebatch_put(writebatch, key_data, key_len, value_data,
+                         value_len);
+  count->puts++;
+  count->bytes += key_len + value_len;
+  count->reserved += namespace_reserved(key_data, key_len);
+}
+
+static void writebatch_delete(leveldb_writebatch_t *writebatch,
+                              writebatch_count *count,
+                              const char *key_data, size_t key_len) {
+  leveldb_writebatch_delete(writebatch, key_data, key_len);
+  count->deletes++;
+  count->bytes += key_len;
+  count->reserved += namespace_reserved(key_data, key_len);
+}
+
 leveldb_readoptions_t* rleveldb_get_readoptions(SEXP r_readoptions,
                                                 bool closed_error) {
   if (r_readoptions == R_NilValue) {
@@ -920,18 +2694,19 @@ void rleveldb_handle_error(char* err) {
   }
 }
 
-size_t rleveldb_get_keys_len(leveldb_t *db,
-                             const char *starts_with, size_t starts_with_len,
-                             leveldb_readoptions_t *readoptions) {
+size_t rleveldb_get_keys_len(leveldb_t *db, const rleveldb_range *range,
+                             const rleveldb_filter *filter,
+                             leveldb_readoptions_t *readoptions,
+                             rleveldb_stats *stats) {
   leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
-  size_t n = 0;
-  for (leveldb_iter_seek_to_first(it);
-       leveldb_iter_valid(it);
+  size_t n = 0, scanned = 0;
+  for (range_seek(it, range);
+       n < range->limit && range_valid(it, range);
        leveldb_iter_next(it)) {
-    if (iter_key_starts_with(it, starts_with, starts_with_len)) {
-      ++n;
-    }
+    ++scanned;
+    n += filter_match(filter, it);
   }
+  stats_scan(stats, it, scanned, n, range->limit);
   leveldb_iter_destroy(it);
   return n;
 }
@@ -939,22 +2714,435 @@ size_t rleveldb_get_keys_len(leveldb_t *db,
 // NOTE: this uses `int*` for found, not `bool*` because it is
 // designed to work with passing things back using an R LGLSXP (where
 // things are stored as integers because of NA values)
+//
+// This uses point lookups rather than seeking an iterator, because
+// a Get can consult the bloom filter (if one was configured) and skip
+// reading blocks that can't contain the key, while a Seek has to
+// merge every level.  Missing keys are therefore nearly free.  The C
+// API offers no way of avoiding the copy of the value on a hit, but
+// it is released immediately.
 void rleveldb_get_exists(leveldb_t *db, size_t num_key,
                          const char **key_data, size_t *key_len,
-                         leveldb_readoptions_t *readoptions, int *found) {
-  leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
+                         leveldb_readoptions_t *readoptions, int *found,
+                         rleveldb_stats *stats) {
   for (size_t i = 0; i < num_key; ++i) {
-    leveldb_iter_seek(it, key_data[i], key_len[i]);
-    if (leveldb_iter_valid(it)) {
-      size_t it_key_len;
-      const char *it_key_data = leveldb_iter_key(it, &it_key_len);
-      found[i] = (it_key_len == key_len[i] &&
-                  memcmp(it_key_data, key_data[i], key_len[i]) == 0);
+    char *err = NULL;
+    size_t read_len;
+    char *read = leveldb_get(db, readoptions, key_data[i], key_len[i],
+                             &read_len, &err);
+    rleveldb_handle_error(err);
+    stats_read(stats, STATS_PATH_EXISTS, read, read_len);
+    found[i] = read != NULL;
+    if (read != NULL) {
+      leveldb_free(read);
+    }
+  }
+}
+
+SEXP rleveldb_iter_step_n(SEXP r_it, SEXP r_n, SEXP r_as_raw, bool forward) {
+  leveldb_iterator_t *it = rleveldb_get_iterator(r_it, true);
+  size_t n = scalar_size(r_n);
+  return_as as_raw = to_return_as(r_as_raw);
+  collector keys, values;
+  collector_init(&keys);
+  collector_init(&values);
+  while (keys.n < n && leveldb_iter_valid(it)) {
+    size_t key_len, value_len;
+    const char *key_data = leveldb_iter_key(it, &key_len);
+    const char *value_data = leveldb_iter_value(it, &value_len);
+    collector_push(&keys, key_data, key_len);
+    collector_push(&values, value_data, value_len);
+    if (forward) {
+      leveldb_iter_next(it);
     } else {
-      found[i] = 0;
+      leveldb_iter_prev(it);
+    }
+  }
+  return rleveldb_scan_result(&keys, &values, as_raw);
+}
+
+static void parallel_scan_worker(void *data, size_t from, size_t to) {
+  parallel_scan_data *d = (parallel_scan_data*) data;
+  for (size_t i = from; i < to; ++i) {
+    parallel_scan_part *part = d->parts + i;
+    leveldb_iterator_t *it = leveldb_create_iterator(d->db, d->readoptions);
+    for (range_seek(it, &part->range); range_valid(it, &part->range);
+         leveldb_iter_next(it)) {
+      part->scanned++;
+      if (!filter_match(d->filter, it)) {
+        continue;
+      }
+      size_t key_len, value_len;
+      const char *key_data = leveldb_iter_key(it, &key_len);
+      const char *value_data = leveldb_iter_value(it, &value_len);
+      part->n++;
+      part->key_bytes += key_len;
+      part->value_bytes += value_len;
+      if (d->what != PARALLEL_SCAN_COUNT) {
+        collector_push(&part->keys, key_data, key_len);
+      }
+      if (d->what == PARALLEL_SCAN_SCAN) {
+        collector_push(&part->values, value_data, value_len);
+      }
+    }
+    leveldb_iter_get_error(it, &part->err);
+    leveldb_iter_destroy(it);
+  }
+}
+
+// Free the parts of a parallel scan now rather than waiting for the
+// garbage collector (also used as the finaliser).
+void parallel_scan_release(SEXP r_parts) {
+  parallel_scan_parts *parts =
+    (parallel_scan_parts*) R_ExternalPtrAddr(r_parts);
+  if (parts != NULL) {
+    for (size_t i = 0; i <= parts->n; ++i) {
+      parallel_scan_part *part = parts->part + i;
+      collector_free(&part->keys);
+      collector_free(&part->values);
+      if (part->err != NULL) {
+        leveldb_free(part->err);
+      }
+    }
+    free(parts);
+    R_ClearExternalPtr(r_parts);
+  }
+}
+
+static void repair_task_work(rleveldb_task *task, void *data) {
+  repair_task *d = (repair_task*) data;
+  leveldb_options_t *options = leveldb_options_create();
+  if (!comparator_is_bytewise(d->comparator)) {
+    leveldb_options_set_comparator(options,
+                                   comparator_leveldb(d->comparator));
+  }
+  leveldb_repair_db(options, d->path, &d->err);
+  leveldb_options_destroy(options);
+}
+
+static void write_task_work(rleveldb_task *task, void *data) {
+  write_task *d = (write_task*) data;
+  double keys = d->count.puts + d->count.deletes;
+  task_total(task, keys, d->count.bytes);
+  task_progress(task, 0, 0);
+  leveldb_write(d->db, d->writeoptions, d->writebatch, &d->err);
+  if (d->err == NULL) {
+    task_progress(task, keys, d->count.bytes);
+  }
+}
+
+static void compact_task_work(rleveldb_task *task, void *data) {
+  compact_task *d = (compact_task*) data;
+  double total = 0, bytes = 0;
+  for (size_t i = 0; i < d->n; ++i) {
+    total += d->sizes[i];
+  }
+  task_total(task, NAN, total);
+  task_progress(task, NAN, 0);
+  for (; d->done < d->n && !task_cancelled(task); ++d->done) {
+    size_t i = d->done;
+    leveldb_compact_range(d->db, d->bounds[i], d->bounds_len[i],
+                          d->bounds[i + 1], d->bounds_len[i + 1]);
+    bytes += d->sizes[i];
+    task_progress(task, NAN, bytes);
+  }
+}
+
+static void keys_task_work(rleveldb_task *task, void *data) {
+  keys_task *d = (keys_task*) data;
+  keys_task_step(d, task, SIZE_MAX);
+  leveldb_iter_destroy(d->it);
+  d->it = NULL;
+  task_progress(task, d->keys.n, d->keys.bytes);
+}
+
+// Continue the pass over the range.  Returns true once it is done, or
+// false if it stopped early: after scanning 'budget' keys or, if
+// running as a task, on being cancelled.
+static bool keys_task_step(keys_task *d, rleveldb_task *task, size_t budget) {
+  const rleveldb_range *range = &d->range;
+  leveldb_iterator_t *it = d->it;
+  for (size_t i = 0;
+       d->keys.n < range->limit && range_valid(it, range);
+       leveldb_iter_next(it)) {
+    if (i++ == budget) {
+      return false;
+    }
+    if (task != NULL && i % TASK_CHECK_EVERY == 0) {
+      task_progress(task, d->keys.n, d->keys.bytes);
+      if (task_cancelled(task)) {
+        return false;
+      }
+    }
+    ++d->scanned;
+    if (!filter_match(d->filter, it)) {
+      continue;
+    }
+    size_t key_len;
+    const char *key_data = leveldb_iter_key(it, &key_len);
+    collector_push(&d->keys, key_data + range->strip,
+                   key_len - range->strip);
+  }
+  // As for stats_scan, count the key that ended the loop
+  d->scanned += d->keys.n < range->limit && leveldb_iter_valid(it);
+  return true;
+}
+
+// One more than the largest id in the registry
+static size_t namespace_next_id(leveldb_t *db,
+                                const rleveldb_comparator *comparator) {
+  char registry[NAMESPACE_PREFIX_LEN];
+  namespace_prefix(0, registry);
+  rleveldb_range range = {registry, NAMESPACE_PREFIX_LEN, NULL, 0, NULL, 0,
+                          RANGE_NO_LIMIT, 0, comparator, false};
+  size_t id = 0;
+  leveldb_iterator_t *it = leveldb_create_iterator(db, default_readoptions);
+  for (range_seek(it, &range); range_valid(it, &range);
+       leveldb_iter_next(it)) {
+    size_t value_len;
+    const char *value = leveldb_iter_value(it, &value_len);
+    size_t value_id = namespace_id(value, value_len);
+    if (value_id > id) {
+      id = value_id;
     }
   }
   leveldb_iter_destroy(it);
+  return id + 1;
+}
+
+// A namespace's keys are only stored together in bytewise or reverse
+// order; under the other comparators its size is unknown.
+static double namespace_size(leveldb_t *db,
+                             const rleveldb_comparator *comparator,
+                             SEXP r_prefix) {
+  rleveldb_range range = {(const char*) RAW(r_prefix), NAMESPACE_PREFIX_LEN,
+                          NULL, 0, NULL, 0, RANGE_NO_LIMIT, 0, NULL, false};
+  const char *start = range.starts_with, *limit = NULL;
+  size_t start_len = range.starts_with_len,
+    limit_len = range_upper(&range, &limit);
+  switch (comparator_type_of(comparator)) {
+  case COMPARATOR_BYTEWISE:
+    break;
+  case COMPARATOR_REVERSE:
+    start = limit;
+    start_len = limit_len;
+    limit = range.starts_with;
+    limit_len = range.starts_with_len;
+    break;
+  default:
+    return NA_REAL;
+  }
+  uint64_t size = 0;
+  leveldb_approximate_sizes(db, 1, &start, &start_len, &limit, &limit_len,
+                            &size);
+  return size;
+}
+
+typedef struct namespace_call {
+  namespace_op *op;
+  SEXP r_db;
+  SEXP r_ns;
+  SEXP *args;
+  rleveldb_stats before;
+  int reserved;
+} namespace_call;
+
+static SEXP namespace_call_run(void *data);
+static void namespace_call_end(void *data);
+
+// The operation runs with a cleanup handler that adds the change in
+// the connection's counters to the namespace's, so that the counts
+// are kept even if the operation throws (or is interrupted).  The
+// reserved keys are opened up to the operation for the duration of
+// the call, and closed again by the same handler.
+static SEXP namespace_run(SEXP r_ns, namespace_op *op, SEXP *args) {
+  namespace_call call;
+  call.op = op;
+  call.r_db = namespace_check(r_ns);
+  call.r_ns = r_ns;
+  call.args = args;
+  rleveldb_get_db(call.r_db, true);
+  call.before = *rleveldb_get_stats(call.r_db);
+  int *reserved = LOGICAL(VECTOR_ELT(rleveldb_tag(call.r_db), TAG_RESERVED));
+  call.reserved = *reserved;
+  *reserved = false;
+  return R_ExecWithCleanup(namespace_call_run, &call,
+                           namespace_call_end, &call);
+}
+
+static SEXP namespace_call_run(void *data) {
+  namespace_call *call = (namespace_call*) data;
+  return call->op(call->r_db, call->r_ns, call->args);
+}
+
+// Must not allocate (this may run during a longjmp)
+static void namespace_call_end(void *data) {
+  namespace_call *call = (namespace_call*) data;
+  rleveldb_stats *stats =
+    (rleveldb_stats*) RAW(VECTOR_ELT(call->r_ns, NS_STATS));
+  stats_accumulate(stats, &call->before, rleveldb_get_stats(call->r_db));
+  LOGICAL(VECTOR_ELT(rleveldb_tag(call->r_db), TAG_RESERVED))[0] =
+    call->reserved;
+}
+
+// Free the keys now rather than waiting for the garbage collector
+// (also used as the finaliser).
+static void keys_task_release(SEXP r_data) {
+  keys_task *data = (keys_task*) R_ExternalPtrAddr(r_data);
+  if (data != NULL) {
+    collector_free(&data->keys);
+    free(data);
+    R_ClearExternalPtr(r_data);
+  }
+}
+
+typedef struct mget_parallel_data {
+  leveldb_t *db;
+  leveldb_readoptions_t *readoptions;
+  const char **key_data;
+  size_t *key_len;
+  char **reads;
+  size_t *reads_len;
+  char **errs;
+} mget_parallel_data;
+
+static void mget_parallel_worker(void *data, size_t from, size_t to) {
+  mget_parallel_data *d = (mget_parallel_data*) data;
+  for (size_t i = from; i < to; ++i) {
+    d->errs[i] = NULL;
+    d->reads[i] = leveldb_get(d->db, d->readoptions,
+                              d->key_data[i], d->key_len[i],
+                              d->reads_len + i, d->errs + i);
+  }
+}
+
+// leveldb's Get is thread-safe, so the reads can be spread over a set
+// of native threads, each writing into its own slots of 'reads'.  On
+// return every read has succeeded and (when returning strings) is
+// known to convert to a string without error, so the caller can
+// create R objects without risk of leaking the remaining buffers.
+void rleveldb_mget_parallel(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                            size_t num_key, const char **key_data,
+                            size_t *key_len, return_as as_raw,
+                            size_t nthreads, char **reads, size_t *reads_len) {
+  mget_parallel_data data;
+  data.db = db;
+  data.readoptions = readoptions;
+  data.key_data = key_data;
+  data.key_len = key_len;
+  data.reads = reads;
+  data.reads_len = reads_len;
+  data.errs = (char**) R_alloc(num_key, sizeof(char*));
+  parallel_for(num_key, nthreads, mget_parallel_worker, &data);
+
+  char *err = NULL;
+  bool has_nul = false;
+  for (size_t i = 0; i < num_key; ++i) {
+    if (data.errs[i] != NULL) {
+      if (err == NULL) {
+        err = data.errs[i];
+      } else {
+        leveldb_free(data.errs[i]);
+      }
+    } else if (as_raw == AS_STRING && reads[i] != NULL) {
+      has_nul = has_nul || memchr(reads[i], '\0', reads_len[i]) != NULL;
+    }
+  }
+  if (err != NULL || has_nul) {
+    for (size_t i = 0; i < num_key; ++i) {
+      if (reads[i] != NULL) {
+        leveldb_free(reads[i]);
+      }
+    }
+    rleveldb_handle_error(err);
+    Rf_error("Value contains embedded nul bytes; cannot return string");
+  }
+}
+
+// Look up keys in sorted order with a single iterator, so that
+// clustered keys are read in a near-sequential sweep through the
+// blocks rather than each descending through every level.  The
+// iterator always sits on the first key at or after the previously
+// sought key; if that is at or after the next sought key then it is
+// also the first key at or after *that* key and no seek is needed.
+void rleveldb_mget_sorted(leveldb_t *db, leveldb_readoptions_t *readoptions,
+                          size_t num_key, const char **key_data,
+                          size_t *key_len, return_as as_raw,
+                          SEXP ret, bool *found, rleveldb_stats *stats) {
+  sorted_key *keys = (sorted_key*) R_alloc(num_key, sizeof(sorted_key));
+  for (size_t i = 0; i < num_key; ++i) {
+    keys[i].data = key_data[i];
+    keys[i].len = key_len[i];
+    keys[i].index = i;
+    found[i] = false;
+  }
+  qsort(keys, num_key, sizeof(sorted_key), sorted_key_compare);
+
+  // NOTE: nothing from here until the iterator is destroyed may throw,
+  // other than on allocation failure.
+  leveldb_iterator_t *it = leveldb_create_iterator(db, readoptions);
+  bool sought = false, has_nul = false;
+  for (size_t j = 0; j < num_key && !has_nul; ++j) {
+    sorted_key *k = keys + j;
+    int cmp = -1;
+    size_t it_key_len;
+    const char *it_key_data;
+    if (sought) {
+      if (!leveldb_iter_valid(it)) {
+        // Past the last key, so all remaining keys are missing
+        break;
+      }
+      it_key_data = leveldb_iter_key(it, &it_key_len);
+      cmp = compare_bytes(it_key_data, it_key_len, k->data, k->len);
+    }
+    if (cmp < 0) {
+      leveldb_iter_seek(it, k->data, k->len);
+      sought = true;
+      if (leveldb_iter_valid(it)) {
+        it_key_data = leveldb_iter_key(it, &it_key_len);
+        cmp = compare_bytes(it_key_data, it_key_len, k->data, k->len);
+      } else {
+        cmp = 1;
+      }
+    }
+    if (cmp == 0) {
+      size_t value_len;
+      const char *value_data = leveldb_iter_value(it, &value_len);
+      if (as_raw == AS_STRING) {
+        has_nul = memchr(value_data, '\0', value_len) != NULL;
+        if (!has_nul) {
+          SET_STRING_ELT(ret, k->index, mkCharLen(value_data, value_len));
+        }
+      } else {
+        SET_VECTOR_ELT(ret, k->index,
+                       raw_string_to_sexp(value_data, value_len, as_raw));
+      }
+      found[k->index] = !has_nul;
+      stats_read(stats, STATS_PATH_MGET_SORTED, value_data, value_len);
+    }
+  }
+  leveldb_iter_destroy(it);
+  if (has_nul) {
+    Rf_error("Value contains embedded nul bytes; cannot return string");
+  }
+}
+
+SEXP rleveldb_scan_result(collector *keys, collector *values,
+                          return_as as_raw) {
+  SEXP ret = PROTECT(allocVector(VECSXP, 2));
+  if (as_raw == AS_RAW) {
+    SET_VECTOR_ELT(ret, 0, collector_finalize_packed(keys));
+    SET_VECTOR_ELT(ret, 1, collector_finalize_packed(values));
+  } else {
+    SET_VECTOR_ELT(ret, 0, collector_finalize(keys, as_raw));
+    SET_VECTOR_ELT(ret, 1, collector_finalize(values, as_raw));
+  }
+  SEXP nms = PROTECT(allocVector(STRSXP, 2));
+  SET_STRING_ELT(nms, 0, mkChar("key"));
+  SET_STRING_ELT(nms, 1, mkChar("value"));
+  setAttrib(ret, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return ret;
 }
 
 leveldb_options_t* rleveldb_collect_options(SEXP r_create_if_missing,
@@ -1014,14 +3202,3 @@ bool check_iterator(leveldb_iterator_t *it, SEXP r_error_if_invalid) {
 
 leveldb_readoptions_t * default_readoptions = NULL;
 leveldb_writeoptions_t * default_writeoptions = NULL;
-
-bool iter_key_starts_with(leveldb_iterator_t *it, const char *starts_with,
-                          size_t starts_with_len) {
-  if (starts_with_len == 0) {
-    return true;
-  }
-  size_t key_len;
-  const char *key_data = leveldb_iter_key(it, &key_len);
-  return key_len >= starts_with_len &&
-    memcmp(key_data, starts_with, starts_with_len) == 0;
-}
@@ -10,26 +10,59 @@ SEXP rleveldb_open(SEXP r_path,
                    SEXP r_block_size,
                    SEXP r_use_compression,
                    SEXP r_cache_capacity,
-                   SEXP r_bloom_filter_bits_per_key);
+                   SEXP r_bloom_filter_bits_per_key,
+                   SEXP r_comparator,
+                   SEXP r_env);
 SEXP rleveldb_close(SEXP r_db, SEXP r_error_if_closed);
-SEXP rleveldb_destroy(SEXP r_path);
-SEXP rleveldb_repair(SEXP r_path);
+SEXP rleveldb_destroy(SEXP r_path, SEXP r_env);
+SEXP rleveldb_repair(SEXP r_path, SEXP r_comparator, SEXP r_progress);
 SEXP rleveldb_property(SEXP r_db, SEXP r_name, SEXP r_error_if_missing);
 
 SEXP rleveldb_get(SEXP r_db, SEXP r_key, SEXP r_as_raw,
-                  SEXP r_error_if_missing, SEXP r_readoptions);
+                  SEXP r_error_if_missing, SEXP r_zero_copy,
+                  SEXP r_readoptions);
 SEXP rleveldb_mget(SEXP r_db, SEXP r_key, SEXP r_as_raw,
                    SEXP r_missing_value, SEXP r_missing_report,
+                   SEXP r_nthreads, SEXP r_sorted, SEXP r_zero_copy,
                    SEXP r_readoptions);
 
 SEXP rleveldb_put(SEXP r_db, SEXP r_key, SEXP r_value, SEXP r_writeoptions);
 SEXP rleveldb_mput(SEXP r_db, SEXP r_key, SEXP r_value, SEXP r_writeoptions);
+SEXP rleveldb_put_object(SEXP r_db, SEXP r_key, SEXP r_value,
+                         SEXP r_compact, SEXP r_writeoptions);
+SEXP rleveldb_get_object(SEXP r_db, SEXP r_key, SEXP r_error_if_missing,
+                         SEXP r_readoptions);
+SEXP rleveldb_mget_object(SEXP r_db, SEXP r_key, SEXP r_missing_report,
+                          SEXP r_readoptions);
+SEXP rleveldb_mput_object(SEXP r_db, SEXP r_key, SEXP r_value,
+                          SEXP r_compact, SEXP r_writeoptions);
 
 SEXP rleveldb_delete(SEXP r_db, SEXP r_key, SEXP r_report,
                      SEXP r_readoptions, SEXP r_writeoptions);
 SEXP rleveldb_delete_silent(SEXP r_db, SEXP r_key, SEXP r_writeoptions);
 SEXP rleveldb_delete_report(SEXP r_db, SEXP r_key, SEXP r_readoptions,
                             SEXP r_writeoptions);
+SEXP rleveldb_delete_range(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                           SEXP r_end, SEXP r_batch_size, SEXP r_compact,
+                           SEXP r_writeoptions);
+
+SEXP rleveldb_bulk_load(SEXP r_db, SEXP r_key, SEXP r_value,
+                        SEXP r_batch_size, SEXP r_nthreads, SEXP r_compact,
+                        SEXP r_writeoptions);
+
+SEXP rleveldb_writer_create(SEXP r_db, SEXP r_sync, SEXP r_batch_keys,
+                            SEXP r_batch_bytes, SEXP r_delay_ms);
+SEXP rleveldb_writer_put(SEXP r_writer, SEXP r_key, SEXP r_value);
+SEXP rleveldb_writer_delete(SEXP r_writer, SEXP r_key);
+SEXP rleveldb_writer_flush(SEXP r_writer);
+SEXP rleveldb_writer_close(SEXP r_writer, SEXP r_error_if_closed);
+SEXP rleveldb_writer_status(SEXP r_writer);
+
+SEXP rleveldb_prefetch_create(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                              SEXP r_end, SEXP r_limit, SEXP r_chunk_size,
+                              SEXP r_depth, SEXP r_readoptions);
+SEXP rleveldb_prefetch_next(SEXP r_prefetch, SEXP r_as_raw);
+SEXP rleveldb_prefetch_close(SEXP r_prefetch, SEXP r_error_if_closed);
 
 SEXP rleveldb_iter_create(SEXP r_db, SEXP r_readoptions);
 SEXP rleveldb_iter_destroy(SEXP r_it, SEXP r_error_if_destroyed);
@@ -41,6 +74,8 @@ SEXP rleveldb_iter_next(SEXP r_it, SEXP r_error_if_invalid);
 SEXP rleveldb_iter_prev(SEXP r_it, SEXP r_error_if_invalid);
 SEXP rleveldb_iter_key(SEXP r_it, SEXP r_as_raw, SEXP r_error_if_invalid);
 SEXP rleveldb_iter_value(SEXP r_it, SEXP r_as_raw, SEXP r_error_if_invalid);
+SEXP rleveldb_iter_next_n(SEXP r_it, SEXP r_n, SEXP r_as_raw);
+SEXP rleveldb_iter_prev_n(SEXP r_it, SEXP r_n, SEXP r_as_raw);
 
 SEXP rleveldb_snapshot_create(SEXP r_db);
 
@@ -50,20 +85,72 @@ SEXP rleveldb_writebatch_clear(SEXP r_writebatch);
 SEXP rleveldb_writebatch_put(SEXP r_writebatch, SEXP r_key, SEXP r_value);
 SEXP rleveldb_writebatch_mput(SEXP r_writebatch, SEXP r_key, SEXP r_value);
 SEXP rleveldb_writebatch_delete(SEXP r_writebatch, SEXP r_key);
-SEXP rleveldb_write(SEXP r_db, SEXP r_writebatch, SEXP r_writeoptions);
+SEXP rleveldb_writebatch_mdelete(SEXP r_writebatch, SEXP r_key);
+SEXP rleveldb_write(SEXP r_db, SEXP r_writebatch, SEXP r_progress,
+                    SEXP r_writeoptions);
 
 SEXP rleveldb_approximate_sizes(SEXP r_db, SEXP r_start_key, SEXP r_limit_key);
-SEXP rleveldb_compact_range(SEXP r_db, SEXP r_start_key, SEXP r_limit_key);
+SEXP rleveldb_size_histogram(SEXP r_db, SEXP r_n_buckets,
+                             SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                             SEXP r_as_raw);
+SEXP rleveldb_compact_range(SEXP r_db, SEXP r_start_key, SEXP r_limit_key,
+                            SEXP r_progress);
+
+SEXP rleveldb_env_create(SEXP r_type, SEXP r_rate_limit);
+SEXP rleveldb_env_stats(SEXP r_env, SEXP r_reset);
+SEXP rleveldb_cache_create(SEXP r_capacity);
+SEXP rleveldb_bloom_create(SEXP r_bits_per_key);
 
 SEXP rleveldb_readoptions(SEXP r_verify_checksums, SEXP r_fill_cache,
                           SEXP r_snapshot);
 SEXP rleveldb_writeoptions(SEXP r_sync);
 
-SEXP rleveldb_keys(SEXP r_db, SEXP r_starts_with, SEXP r_as_raw,
+SEXP rleveldb_keys(SEXP r_db, SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                   SEXP r_limit, SEXP r_as_raw, SEXP r_filter,
+                   SEXP r_progress, SEXP r_readoptions);
+SEXP rleveldb_keys_len(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                       SEXP r_end, SEXP r_limit, SEXP r_filter,
+                       SEXP r_readoptions);
+SEXP rleveldb_scan(SEXP r_db, SEXP r_starts_with, SEXP r_start, SEXP r_end,
+                   SEXP r_limit, SEXP r_as_raw, SEXP r_filter,
                    SEXP r_readoptions);
-SEXP rleveldb_keys_len(SEXP r_db, SEXP r_starts_with, SEXP r_readoptions);
+SEXP rleveldb_parallel_scan(SEXP r_db, SEXP r_starts_with, SEXP r_start,
+                            SEXP r_end, SEXP r_what, SEXP r_nthreads,
+                            SEXP r_as_raw, SEXP r_filter,
+                            SEXP r_readoptions);
+
+SEXP rleveldb_namespace(SEXP r_db, SEXP r_name, SEXP r_create);
+SEXP rleveldb_namespace_list(SEXP r_db);
+SEXP rleveldb_ns_get(SEXP r_ns, SEXP r_key, SEXP r_as_raw,
+                     SEXP r_error_if_missing, SEXP r_readoptions);
+SEXP rleveldb_ns_mget(SEXP r_ns, SEXP r_key, SEXP r_as_raw,
+                      SEXP r_missing_value, SEXP r_missing_report,
+                      SEXP r_nthreads, SEXP r_sorted, SEXP r_readoptions);
+SEXP rleveldb_ns_put(SEXP r_ns, SEXP r_key, SEXP r_value,
+                     SEXP r_writeoptions);
+SEXP rleveldb_ns_mput(SEXP r_ns, SEXP r_key, SEXP r_value,
+                      SEXP r_writeoptions);
+SEXP rleveldb_ns_delete(SEXP r_ns, SEXP r_key, SEXP r_writeoptions);
+SEXP rleveldb_ns_exists(SEXP r_ns, SEXP r_key, SEXP r_readoptions);
+SEXP rleveldb_ns_keys(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                      SEXP r_end, SEXP r_limit, SEXP r_as_raw,
+                      SEXP r_readoptions);
+SEXP rleveldb_ns_keys_len(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                          SEXP r_end, SEXP r_limit, SEXP r_readoptions);
+SEXP rleveldb_ns_scan(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                      SEXP r_end, SEXP r_limit, SEXP r_as_raw,
+                      SEXP r_readoptions);
+SEXP rleveldb_ns_delete_range(SEXP r_ns, SEXP r_starts_with, SEXP r_start,
+                              SEXP r_end, SEXP r_batch_size, SEXP r_compact,
+                              SEXP r_writeoptions);
+SEXP rleveldb_ns_size(SEXP r_ns);
+SEXP rleveldb_ns_stats(SEXP r_ns, SEXP r_reset);
+
+SEXP rleveldb_unpack(SEXP r_x, SEXP r_as_raw);
+SEXP rleveldb_stats_get(SEXP r_db, SEXP r_reset);
 SEXP rleveldb_exists(SEXP r_db, SEXP r_key, SEXP r_readoptions);
 SEXP rleveldb_version();
+SEXP rleveldb_clock();
 SEXP rleveldb_tag(SEXP r_db);
 void rleveldb_init();
 void rleveldb_cleanup();
@@ -0,0 +1,295 @@
+#include "serialize.h"
+#include <stdint.h>
+#include <leveldb/c.h>
+
+// R objects are stored either in R's own serialisation format (XDR,
+// exactly as produced by serialize(x, NULL), so values can be written
+// and read from either side) or, for atomic vectors without
+// attributes, a compact typed format that avoids the per-element
+// overhead of XDR conversion:
+//
+//   bytes 0-2   "RLV"
+//   byte  3     SEXPTYPE of the vector
+//   byte  4     1 if written on a little-endian machine, else 0
+//   bytes 5-7   (reserved, zero)
+//   bytes 8-15  length of the vector (uint64, native byte order)
+//   bytes 16-   the data in native byte order; for character vectors
+//               each element is an int32 byte count (-1 for NA)
+//               followed by its UTF-8 bytes
+//
+// Serialised R data always starts with a format byte ('X', 'A' or
+// 'B') then a newline, so the two formats can't be confused.
+#define COMPACT_HEADER_LEN 16
+
+static void object_buffer_finalize(SEXP r_ptr);
+static void leveldb_buffer_finalize(SEXP r_ptr);
+static void object_buffer_reserve(object_buffer *buffer, size_t len);
+static void object_buffer_append(object_buffer *buffer, const void *data,
+                                 size_t len);
+static bool object_can_compact(SEXP x);
+static void object_serialize_compact(SEXP x, object_buffer *buffer);
+static SEXP object_unserialize_compact(const unsigned char *data, size_t len);
+static bool is_little_endian();
+
+static void out_char(R_outpstream_t stream, int c);
+static void out_bytes(R_outpstream_t stream, void *buf, int len);
+static int in_char(R_inpstream_t stream);
+static void in_bytes(R_inpstream_t stream, void *buf, int len);
+
+typedef struct input_buffer {
+  const unsigned char *data;
+  size_t len;
+  size_t pos;
+} input_buffer;
+
+object_buffer* object_buffer_create(SEXP *r_ptr) {
+  object_buffer *buffer = (object_buffer*) calloc(1, sizeof(object_buffer));
+  if (buffer == NULL) {
+    Rf_error("Failed to allocate serialisation buffer");
+  }
+  *r_ptr = R_MakeExternalPtr(buffer, R_NilValue, R_NilValue);
+  R_RegisterCFinalizerEx(*r_ptr, object_buffer_finalize, TRUE);
+  return buffer;
+}
+
+// Free the buffer now rather than waiting for the garbage collector.
+void object_buffer_release(SEXP r_ptr) {
+  object_buffer_finalize(r_ptr);
+}
+
+void object_serialize(SEXP x, bool compact, object_buffer *buffer) {
+  if (compact && object_can_compact(x)) {
+    object_serialize_compact(x, buffer);
+  } else {
+    struct R_outpstream_st stream;
+    R_InitOutPStream(&stream, (R_pstream_data_t) buffer,
+                     R_pstream_xdr_format, 0, out_char, out_bytes,
+                     NULL, R_NilValue);
+    R_Serialize(x, &stream);
+  }
+}
+
+SEXP object_unserialize(const char *data, size_t len) {
+  const unsigned char *bytes = (const unsigned char *) data;
+  if (len >= 3 && memcmp(bytes, "RLV", 3) == 0) {
+    return object_unserialize_compact(bytes, len);
+  }
+  input_buffer input = {bytes, len, 0};
+  struct R_inpstream_st stream;
+  R_InitInPStream(&stream, (R_pstream_data_t) &input, R_pstream_any_format,
+                  in_char, in_bytes, NULL, R_NilValue);
+  return R_Unserialize(&stream);
+}
+
+// Like leveldb_buffer_to_sexp, this takes ownership of a buffer
+// allocated by leveldb; it is held by an external pointer while
+// unserialising so that it is not leaked if the data are corrupt.
+SEXP leveldb_buffer_to_object(char *buf, size_t len) {
+  SEXP r_ptr = PROTECT(R_MakeExternalPtr(buf, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(r_ptr, leveldb_buffer_finalize, TRUE);
+  SEXP ret = PROTECT(object_unserialize(buf, len));
+  leveldb_free(buf);
+  R_ClearExternalPtr(r_ptr);
+  UNPROTECT(2);
+  return ret;
+}
+
+static void object_buffer_finalize(SEXP r_ptr) {
+  object_buffer *buffer = (object_buffer*) R_ExternalPtrAddr(r_ptr);
+  if (buffer) {
+    free(buffer->data);
+    free(buffer);
+    R_ClearExternalPtr(r_ptr);
+  }
+}
+
+// For a buffer from leveldb, which is not an object_buffer
+static void leveldb_buffer_finalize(SEXP r_ptr) {
+  void *buf = R_ExternalPtrAddr(r_ptr);
+  if (buf) {
+    leveldb_free(buf);
+    R_ClearExternalPtr(r_ptr);
+  }
+}
+
+static void object_buffer_reserve(object_buffer *buffer, size_t len) {
+  if (buffer->len + len <= buffer->size) {
+    return;
+  }
+  size_t size = buffer->size == 0 ? 4096 : buffer->size;
+  while (size < buffer->len + len) {
+    size *= 2;
+  }
+  unsigned char *data = (unsigned char*) realloc(buffer->data, size);
+  if (data == NULL) {
+    Rf_error("Failed to allocate serialisation buffer");
+  }
+  buffer->data = data;
+  buffer->size = size;
+}
+
+static void object_buffer_append(object_buffer *buffer, const void *data,
+                                 size_t len) {
+  object_buffer_reserve(buffer, len);
+  memcpy(buffer->data + buffer->len, data, len);
+  buffer->len += len;
+}
+
+static bool object_can_compact(SEXP x) {
+  switch (TYPEOF(x)) {
+  case LGLSXP:
+  case INTSXP:
+  case REALSXP:
+  case RAWSXP:
+  case STRSXP:
+    return ATTRIB(x) == R_NilValue;
+  default:
+    return false;
+  }
+}
+
+static void object_serialize_compact(SEXP x, object_buffer *buffer) {
+  unsigned char header[COMPACT_HEADER_LEN] = {'R', 'L', 'V', 0};
+  uint64_t len = XLENGTH(x);
+  header[3] = (unsigned char) TYPEOF(x);
+  header[4] = is_little_endian();
+  memcpy(header + 8, &len, sizeof(uint64_t));
+  object_buffer_append(buffer, header, COMPACT_HEADER_LEN);
+  switch (TYPEOF(x)) {
+  case LGLSXP:
+    object_buffer_append(buffer, LOGICAL(x), len * sizeof(int));
+    break;
+  case INTSXP:
+    object_buffer_append(buffer, INTEGER(x), len * sizeof(int));
+    break;
+  case REALSXP:
+    object_buffer_append(buffer, REAL(x), len * sizeof(double));
+    break;
+  case RAWSXP:
+    object_buffer_append(buffer, RAW(x), len);
+    break;
+  case STRSXP:
+    for (size_t i = 0; i < len; ++i) {
+      SEXP el = STRING_ELT(x, i);
+      int32_t el_len = -1;
+      if (el == NA_STRING) {
+        object_buffer_append(buffer, &el_len, sizeof(int32_t));
+      } else {
+        const char *s = translateCharUTF8(el);
+        el_len = strlen(s);
+        object_buffer_append(buffer, &el_len, sizeof(int32_t));
+        object_buffer_append(buffer, s, el_len);
+      }
+    }
+    break;
+  }
+}
+
+static SEXP object_unserialize_compact(const unsigned char *data,
+                                       size_t len) {
+  if (len < COMPACT_HEADER_LEN) {
+    Rf_error("Corrupt object: truncated header");
+  }
+  if (data[4] != is_little_endian()) {
+    Rf_error("Object was stored on a machine with different byte order");
+  }
+  SEXPTYPE type = data[3];
+  uint64_t n;
+  memcpy(&n, data + 8, sizeof(uint64_t));
+  data += COMPACT_HEADER_LEN;
+  len -= COMPACT_HEADER_LEN;
+
+  size_t el_size;
+  switch (type) {
+  case LGLSXP:
+  case INTSXP:
+  case STRSXP: // minimum size: just the length for each element
+    el_size = sizeof(int);
+    break;
+  case REALSXP:
+    el_size = sizeof(double);
+    break;
+  case RAWSXP:
+    el_size = 1;
+    break;
+  default:
+    Rf_error("Corrupt object: unknown type %d", (int) type);
+  }
+  if (n > len / el_size ||
+      (type != STRSXP && n * el_size != len)) {
+    Rf_error("Corrupt object: length does not match data");
+  }
+
+  SEXP ret = PROTECT(allocVector(type, n));
+  switch (type) {
+  case LGLSXP:
+    memcpy(LOGICAL(ret), data, len);
+    break;
+  case INTSXP:
+    memcpy(INTEGER(ret), data, len);
+    break;
+  case REALSXP:
+    memcpy(REAL(ret), data, len);
+    break;
+  case RAWSXP:
+    memcpy(RAW(ret), data, len);
+    break;
+  case STRSXP: {
+    size_t pos = 0;
+    for (size_t i = 0; i < n; ++i) {
+      int32_t el_len;
+      if (len - pos < sizeof(int32_t)) {
+        Rf_error("Corrupt object: truncated string data");
+      }
+      memcpy(&el_len, data + pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      if (el_len < 0) {
+        SET_STRING_ELT(ret, i, NA_STRING);
+      } else if ((size_t) el_len > len - pos) {
+        Rf_error("Corrupt object: truncated string data");
+      } else {
+        SET_STRING_ELT(ret, i, mkCharLenCE((const char*) data + pos, el_len,
+                                           CE_UTF8));
+        pos += el_len;
+      }
+    }
+    if (pos != len) {
+      Rf_error("Corrupt object: trailing string data");
+    }
+    break;
+  }
+  }
+  UNPROTECT(1);
+  return ret;
+}
+
+static bool is_little_endian() {
+  const uint16_t x = 1;
+  return *((const unsigned char *) &x) == 1;
+}
+
+static void out_char(R_outpstream_t stream, int c) {
+  unsigned char x = (unsigned char) c;
+  object_buffer_append((object_buffer*) stream->data, &x, 1);
+}
+
+static void out_bytes(R_outpstream_t stream, void *buf, int len) {
+  object_buffer_append((object_buffer*) stream->data, buf, len);
+}
+
+static int in_char(R_inpstream_t stream) {
+  input_buffer *input = (input_buffer*) stream->data;
+  if (input->pos >= input->len) {
+    Rf_error("Corrupt object: read past end of data");
+  }
+  return input->data[input->pos++];
+}
+
+static void in_bytes(R_inpstream_t stream, void *buf, int len) {
+  input_buffer *input = (input_buffer*) stream->data;
+  if ((size_t) len > input->len - input->pos) {
+    Rf_error("Corrupt object: read past end of data");
+  }
+  memcpy(buf, input->data + input->pos, len);
+  input->pos += len;
+}
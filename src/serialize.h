@@ -0,0 +1,22 @@
+#ifndef RLEVELDB_SERIALIZE_H
+#define RLEVELDB_SERIALIZE_H
+
+#include <stdbool.h>
+#include <R.h>
+#include <Rinternals.h>
+
+// A growable buffer that serialised objects are written into.  It is
+// owned by an external pointer so that it is freed even if
+// serialisation throws.
+typedef struct object_buffer {
+  unsigned char *data;
+  size_t len;
+  size_t size;
+} object_buffer;
+
+object_buffer* object_buffer_create(SEXP *r_ptr);
+void object_buffer_release(SEXP r_ptr);
+void object_serialize(SEXP x, bool compact, object_buffer *buffer);
+SEXP object_unserialize(const char *data, size_t len);
+SEXP leveldb_buffer_to_object(char *buf, size_t len);
+#endif
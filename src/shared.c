@@ -0,0 +1,70 @@
+#include "shared.h"
+#include <stdlib.h>
+
+typedef struct shared {
+  void *data;
+  shared_destroy *destroy;
+  size_t refs;
+} shared;
+
+static void shared_unref(shared *obj);
+static void shared_finalize(SEXP r_shared);
+
+// The tag records what sort of object this is, so that (say) an Env
+// can't be passed where a cache is expected.
+SEXP shared_create(void *data, shared_destroy *destroy, const char *what) {
+  shared *obj = (shared*) malloc(sizeof(shared));
+  if (obj == NULL) {
+    destroy(data);
+    Rf_error("Could not allocate memory for %s", what);
+  }
+  obj->data = data;
+  obj->destroy = destroy;
+  obj->refs = 1;
+  SEXP ret = PROTECT(R_MakeExternalPtr(obj, install(what), R_NilValue));
+  R_RegisterCFinalizer(ret, shared_finalize);
+  UNPROTECT(1);
+  return ret;
+}
+
+void* shared_get(SEXP r_shared, const char *what) {
+  if (TYPEOF(r_shared) != EXTPTRSXP ||
+      R_ExternalPtrTag(r_shared) != install(what)) {
+    Rf_error("Expected a %s", what);
+  }
+  shared *obj = (shared*) R_ExternalPtrAddr(r_shared);
+  if (obj == NULL) {
+    Rf_error("%s has been released", what);
+  }
+  return obj->data;
+}
+
+// The lease has no finaliser: the database that holds it must release
+// it after closing (a finaliser could run before the database's own).
+SEXP shared_lease(SEXP r_shared, const char *what) {
+  shared_get(r_shared, what);
+  shared *obj = (shared*) R_ExternalPtrAddr(r_shared);
+  ++obj->refs;
+  return R_MakeExternalPtr(obj, R_NilValue, R_NilValue);
+}
+
+void shared_release(SEXP r_lease) {
+  if (TYPEOF(r_lease) == EXTPTRSXP) {
+    shared *obj = (shared*) R_ExternalPtrAddr(r_lease);
+    if (obj != NULL) {
+      R_ClearExternalPtr(r_lease);
+      shared_unref(obj);
+    }
+  }
+}
+
+static void shared_unref(shared *obj) {
+  if (--obj->refs == 0) {
+    obj->destroy(obj->data);
+    free(obj);
+  }
+}
+
+static void shared_finalize(SEXP r_shared) {
+  shared_release(r_shared);
+}
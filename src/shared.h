@@ -0,0 +1,21 @@
+#ifndef RLEVELDB_SHARED_H
+#define RLEVELDB_SHARED_H
+
+#include <R.h>
+#include <Rinternals.h>
+
+// A native object that can be used by several open databases at once
+// (e.g., an Env), and so must outlive all of them.  It is reference
+// counted: the R object made by shared_create holds one reference and
+// each database that uses the object takes another with shared_lease,
+// which it gives back with shared_release once the database has been
+// closed.  The object is destroyed when the last reference goes, so
+// it does not matter in which order the finalisers run.  All of this
+// happens on the R thread.
+typedef void shared_destroy(void *data);
+
+SEXP shared_create(void *data, shared_destroy *destroy, const char *what);
+void* shared_get(SEXP r_shared, const char *what);
+SEXP shared_lease(SEXP r_shared, const char *what);
+void shared_release(SEXP r_lease);
+#endif
@@ -0,0 +1,134 @@
+#include "sort.h"
+#include <stdlib.h>
+#include <string.h>
+#include "parallel.h"
+#include "range.h"
+
+typedef struct sort_data {
+  const rleveldb_comparator *comparator;
+  sorted_key *src;
+  sorted_key *dest;
+  size_t n;
+  size_t n_runs;
+  size_t width; // runs per merged run, in the merge passes
+} sort_data;
+
+static size_t run_start(const sort_data *d, size_t run);
+static void sort_runs(void *data, size_t from, size_t to);
+static void merge_runs(void *data, size_t from, size_t to);
+static int compare_keys(const rleveldb_comparator *comparator,
+                        const sorted_key *a, const sorted_key *b);
+static void merge_sort(const rleveldb_comparator *comparator,
+                       sorted_key *keys, size_t n, sorted_key *work);
+static void merge(const rleveldb_comparator *comparator,
+                  const sorted_key *a, size_t n_a,
+                  const sorted_key *b, size_t n_b, sorted_key *dest);
+
+int sorted_key_compare(const void *a, const void *b) {
+  const sorted_key
+    *ka = (const sorted_key*) a,
+    *kb = (const sorted_key*) b;
+  int ret = compare_bytes(ka->data, ka->len, kb->data, kb->len);
+  // Break ties on position so that the sort is stable
+  if (ret == 0) {
+    ret = ka->index < kb->index ? -1 : 1;
+  }
+  return ret;
+}
+
+// Sort keys into the comparator's order using up to nthreads threads:
+// each thread sorts one run (with qsort if the order is bytewise,
+// since qsort can't be given the comparator), then runs are merged
+// pairwise (each pass merging pairs in parallel).  'work' must have
+// room for n keys.  Does not use the R API.
+void sort_keys(sorted_key *keys, size_t n,
+               const rleveldb_comparator *comparator, size_t nthreads,
+               sorted_key *work) {
+  size_t n_runs = nthreads < 1 ? 1 : nthreads;
+  if (n_runs > n / 1024) {
+    n_runs = n / 1024 > 0 ? n / 1024 : 1;
+  }
+  sort_data d = {comparator, keys, work, n, n_runs, 1};
+  parallel_for(n_runs, n_runs, sort_runs, &d);
+
+  for (; d.width < n_runs; d.width *= 2) {
+    size_t n_merges = (n_runs + 2 * d.width - 1) / (2 * d.width);
+    parallel_for(n_merges, n_merges, merge_runs, &d);
+    sorted_key *tmp = d.src;
+    d.src = d.dest;
+    d.dest = tmp;
+  }
+  if (d.src != keys) {
+    memcpy(keys, d.src, n * sizeof(sorted_key));
+  }
+}
+
+static size_t run_start(const sort_data *d, size_t run) {
+  return run >= d->n_runs ? d->n : run * (d->n / d->n_runs) +
+    (run < d->n % d->n_runs ? run : d->n % d->n_runs);
+}
+
+static void sort_runs(void *data, size_t from, size_t to) {
+  sort_data *d = (sort_data*) data;
+  for (size_t run = from; run < to; ++run) {
+    size_t start = run_start(d, run), end = run_start(d, run + 1);
+    if (comparator_is_bytewise(d->comparator)) {
+      qsort(d->src + start, end - start, sizeof(sorted_key),
+            sorted_key_compare);
+    } else {
+      merge_sort(d->comparator, d->src + start, end - start,
+                 d->dest + start);
+    }
+  }
+}
+
+// Merge i merges runs [2 i w, (2 i + 1) w) with [(2 i + 1) w, (2 i + 2) w)
+static void merge_runs(void *data, size_t from, size_t to) {
+  sort_data *d = (sort_data*) data;
+  for (size_t i = from; i < to; ++i) {
+    size_t
+      a = run_start(d, 2 * i * d->width),
+      mid = run_start(d, (2 * i + 1) * d->width),
+      end = run_start(d, (2 * i + 2) * d->width);
+    merge(d->comparator, d->src + a, mid - a, d->src + mid, end - mid,
+          d->dest + a);
+  }
+}
+
+static int compare_keys(const rleveldb_comparator *comparator,
+                        const sorted_key *a, const sorted_key *b) {
+  int ret = comparator_compare(comparator, a->data, a->len,
+                               b->data, b->len);
+  if (ret == 0) {
+    ret = a->index < b->index ? -1 : 1;
+  }
+  return ret;
+}
+
+// Sorts keys in place, using work (of the same length) as scratch
+static void merge_sort(const rleveldb_comparator *comparator,
+                       sorted_key *keys, size_t n, sorted_key *work) {
+  if (n < 2) {
+    return;
+  }
+  size_t mid = n / 2;
+  merge_sort(comparator, keys, mid, work);
+  merge_sort(comparator, keys + mid, n - mid, work + mid);
+  merge(comparator, keys, mid, keys + mid, n - mid, work);
+  memcpy(keys, work, n * sizeof(sorted_key));
+}
+
+static void merge(const rleveldb_comparator *comparator,
+                  const sorted_key *a, size_t n_a,
+                  const sorted_key *b, size_t n_b, sorted_key *dest) {
+  size_t j = 0, k = 0;
+  while (j < n_a && k < n_b) {
+    if (compare_keys(comparator, a + j, b + k) <= 0) {
+      *dest++ = a[j++];
+    } else {
+      *dest++ = b[k++];
+    }
+  }
+  memcpy(dest, a + j, (n_a - j) * sizeof(sorted_key));
+  memcpy(dest + n_a - j, b + k, (n_b - k) * sizeof(sorted_key));
+}
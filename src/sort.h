@@ -0,0 +1,20 @@
+#ifndef RLEVELDB_SORT_H
+#define RLEVELDB_SORT_H
+
+#include <stddef.h>
+#include "comparator.h"
+
+// A key along with its position in the input, so that results can be
+// written back in input order (and ties broken by position, making
+// the sort stable).
+typedef struct sorted_key {
+  const char *data;
+  size_t len;
+  size_t index;
+} sorted_key;
+
+int sorted_key_compare(const void *a, const void *b);
+void sort_keys(sorted_key *keys, size_t n,
+               const rleveldb_comparator *comparator, size_t nthreads,
+               sorted_key *work);
+#endif
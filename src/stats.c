@@ -0,0 +1,122 @@
+#include "stats.h"
+#include <time.h>
+
+static size_t stats_bucket(double x);
+
+SEXP stats_create() {
+  SEXP ret = PROTECT(allocVector(RAWSXP, sizeof(rleveldb_stats)));
+  stats_reset((rleveldb_stats*) RAW(ret));
+  UNPROTECT(1);
+  return ret;
+}
+
+void stats_reset(rleveldb_stats *stats) {
+  memset(stats, 0, sizeof(rleveldb_stats));
+}
+
+// Returns the raw counters; these are organised into data.frames in
+// R (see leveldb_stats).
+SEXP stats_to_sexp(const rleveldb_stats *stats) {
+  SEXP ret = PROTECT(allocVector(VECSXP, 4));
+
+  const char *counter_names[] = {"puts", "deletes", "writes",
+                                 "bytes_written", "keys_scanned",
+                                 "keys_returned"};
+  const double counters[] = {stats->puts, stats->deletes, stats->writes,
+                             stats->bytes_written, stats->keys_scanned,
+                             stats->keys_returned};
+  const size_t n_counters = sizeof(counters) / sizeof(double);
+  SEXP r_counters = PROTECT(allocVector(REALSXP, n_counters));
+  SEXP r_counter_names = PROTECT(allocVector(STRSXP, n_counters));
+  for (size_t i = 0; i < n_counters; ++i) {
+    REAL(r_counters)[i] = counters[i];
+    SET_STRING_ELT(r_counter_names, i, mkChar(counter_names[i]));
+  }
+  setAttrib(r_counters, R_NamesSymbol, r_counter_names);
+  SET_VECTOR_ELT(ret, 0, r_counters);
+
+  // One row per path; columns found, missing, bytes_read
+  SEXP r_lookups = PROTECT(allocMatrix(REALSXP, STATS_N_PATH, 3));
+  double *lookups = REAL(r_lookups);
+  memcpy(lookups, stats->found, STATS_N_PATH * sizeof(double));
+  memcpy(lookups + STATS_N_PATH, stats->missing,
+         STATS_N_PATH * sizeof(double));
+  memcpy(lookups + 2 * STATS_N_PATH, stats->bytes_read,
+         STATS_N_PATH * sizeof(double));
+  SET_VECTOR_ELT(ret, 1, r_lookups);
+
+  // One column per operation, one row per bucket
+  SEXP r_latency = PROTECT(allocMatrix(REALSXP, STATS_N_BUCKET, STATS_N_OP));
+  memcpy(REAL(r_latency), stats->latency,
+         STATS_N_OP * STATS_N_BUCKET * sizeof(double));
+  SET_VECTOR_ELT(ret, 2, r_latency);
+
+  SEXP r_batch_size = PROTECT(allocVector(REALSXP, STATS_N_BUCKET));
+  memcpy(REAL(r_batch_size), stats->batch_size,
+         STATS_N_BUCKET * sizeof(double));
+  SET_VECTOR_ELT(ret, 3, r_batch_size);
+
+  UNPROTECT(6);
+  return ret;
+}
+
+// Add the change in a set of counters (e.g., over one call) to
+// another set; everything in rleveldb_stats is a double.
+void stats_accumulate(rleveldb_stats *stats, const rleveldb_stats *before,
+                      const rleveldb_stats *after) {
+  double *x = (double*) stats;
+  const double *a = (const double*) before, *b = (const double*) after;
+  const size_t n = sizeof(rleveldb_stats) / sizeof(double);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] += b[i] - a[i];
+  }
+}
+
+// Monotonic time in seconds
+double stats_now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void stats_latency(rleveldb_stats *stats, stats_op op, double start) {
+  double elapsed_us = (stats_now() - start) * 1e6;
+  stats->latency[op][stats_bucket(elapsed_us)]++;
+}
+
+void stats_read(rleveldb_stats *stats, stats_path path, const char *read,
+                size_t read_len) {
+  if (read == NULL) {
+    stats->missing[path]++;
+  } else {
+    stats->found[path]++;
+    stats->bytes_read[path] += read_len;
+  }
+}
+
+// To be called after a loop over a range that looked at 'scanned'
+// keys and returned n of them (fewer than scanned if a filter was
+// used); the key that ended the loop (if any, and if the loop was not
+// stopped by the limit) was also read but not returned.
+void stats_scan(rleveldb_stats *stats, leveldb_iterator_t *it,
+                size_t scanned, size_t n, size_t limit) {
+  stats->keys_returned += n;
+  stats->keys_scanned += scanned + (n < limit && leveldb_iter_valid(it));
+}
+
+void stats_write(rleveldb_stats *stats, size_t puts, size_t deletes,
+                 size_t bytes) {
+  stats->puts += puts;
+  stats->deletes += deletes;
+  stats->bytes_written += bytes;
+  stats->writes++;
+  stats->batch_size[stats_bucket(puts + deletes)]++;
+}
+
+static size_t stats_bucket(double x) {
+  size_t i = 0;
+  for (double upper = 1; x >= upper && i < STATS_N_BUCKET - 1; upper *= 2) {
+    ++i;
+  }
+  return i;
+}
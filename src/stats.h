@@ -0,0 +1,68 @@
+#ifndef RLEVELDB_STATS_H
+#define RLEVELDB_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <leveldb/c.h>
+
+// Cumulative per-connection counters.  These live in a raw vector in
+// the db tag so they are released along with the connection.  They
+// are only updated from the R thread.
+typedef enum stats_op {
+  STATS_OP_GET,
+  STATS_OP_MGET,
+  STATS_OP_PUT,
+  STATS_OP_WRITE,
+  STATS_N_OP
+} stats_op;
+
+// The different ways that keys are looked up
+typedef enum stats_path {
+  STATS_PATH_GET,
+  STATS_PATH_MGET,
+  STATS_PATH_MGET_SORTED,
+  STATS_PATH_MGET_PARALLEL,
+  STATS_PATH_EXISTS,
+  STATS_PATH_OBJECT,
+  STATS_N_PATH
+} stats_path;
+
+// Bucket i holds values in [2^(i - 1), 2^i); the last bucket also
+// holds everything larger.  Latencies are in microseconds and batch
+// sizes in keys.
+#define STATS_N_BUCKET 32
+
+typedef struct rleveldb_stats {
+  double found[STATS_N_PATH];
+  double missing[STATS_N_PATH];
+  double bytes_read[STATS_N_PATH];
+  double puts;
+  double deletes;
+  double writes;
+  double bytes_written;
+  double keys_scanned;
+  double keys_returned;
+  double latency[STATS_N_OP][STATS_N_BUCKET];
+  double batch_size[STATS_N_BUCKET];
+} rleveldb_stats;
+
+SEXP stats_create();
+void stats_reset(rleveldb_stats *stats);
+SEXP stats_to_sexp(const rleveldb_stats *stats);
+
+void stats_accumulate(rleveldb_stats *stats, const rleveldb_stats *before,
+                      const rleveldb_stats *after);
+
+double stats_now();
+void stats_latency(rleveldb_stats *stats, stats_op op, double start);
+void stats_read(rleveldb_stats *stats, stats_path path, const char *read,
+                size_t read_len);
+void stats_scan(rleveldb_stats *stats, leveldb_iterator_t *it,
+                size_t scanned, size_t n, size_t limit);
+// One write of a batch holding the given numbers of puts and deletes
+// (and bytes of keys and values)
+void stats_write(rleveldb_stats *stats, size_t puts, size_t deletes,
+                 size_t bytes);
+#endif
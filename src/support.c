@@ -20,12 +20,47 @@ size_t get_keys(SEXP keys, const char ***key_data, size_t **key_len) {
   return len;
 }
 
+// Values to go with num_key keys: a character vector, a list of
+// strings/raw vectors, or a packed object.
+void get_values(SEXP values, size_t num_key, const char ***value_data,
+                size_t **value_len) {
+  if (is_packed(values)) {
+    size_t num_value = get_keys(values, value_data, value_len);
+    if (num_value != num_key) {
+      Rf_error("Expected %d values but recieved %d",
+               (int) num_key, (int) num_value);
+    }
+    return;
+  }
+  const bool value_is_string = TYPEOF(values) == STRSXP;
+  if (!value_is_string && TYPEOF(values) != VECSXP) {
+    Rf_error("Expected a character vector or list for 'value'");
+  }
+  if ((size_t)length(values) != num_key) {
+    Rf_error("Expected %d values but recieved %d",
+             (int) num_key, length(values));
+  }
+  *value_data = (const char**)R_alloc(num_key, sizeof(const char*));
+  *value_len = (size_t*)R_alloc(num_key, sizeof(size_t));
+  for (size_t i = 0; i < num_key; ++i) {
+    SEXP el = value_is_string ? STRING_ELT(values, i) : VECTOR_ELT(values, i);
+    (*value_len)[i] = get_value(el, *value_data + i);
+  }
+}
+
 size_t get_starts_with(SEXP starts_with, const char **starts_with_data) {
-  if (starts_with == R_NilValue) {
-    *starts_with_data = NULL;
+  return get_bound(starts_with, starts_with_data, "starts_with");
+}
+
+// Like get_key, but NULL is allowed and indicates that the bound is
+// not set (in which case data is set to NULL, which is different to
+// an empty key).
+size_t get_bound(SEXP bound, const char **bound_data, const char *name) {
+  if (bound == R_NilValue) {
+    *bound_data = NULL;
     return 0;
   } else {
-    return get_data(starts_with, starts_with_data, "starts_with");
+    return get_data(bound, bound_data, name);
   }
 }
 
@@ -46,17 +81,42 @@ size_t get_data(SEXP data, const char **data_contents, const char* name) {
   case RAWSXP:
     *data_contents = (const char*) RAW(data);
     return length(data);
+  case VECSXP:
+    if (is_packed(data)) {
+      const double *offset;
+      if (get_packed(data, data_contents, &offset) != 1) {
+        Rf_error("%s must be a packed object of length 1", name);
+      }
+      *data_contents += (size_t) offset[0];
+      return (size_t) offset[1] - (size_t) offset[0];
+    }
+    // fall through
   default:
     Rf_error("Invalid data type for %s; expected string or raw", name);
   }
 }
 
 size_t get_keys_len(SEXP keys) {
+  if (is_packed(keys)) {
+    const char *data;
+    const double *offset;
+    return get_packed(keys, &data, &offset);
+  }
   return TYPEOF(keys) == RAWSXP ? 1 : (size_t)length(keys);
 }
 
+// Packed keys (e.g., from leveldb_key_encode) are used in place,
+// without allocating an R object per key.
 void get_keys_data(size_t len, SEXP keys, const char **data, size_t *data_len) {
-  if (TYPEOF(keys) == RAWSXP) {
+  if (is_packed(keys)) {
+    const char *packed_data;
+    const double *offset;
+    get_packed(keys, &packed_data, &offset);
+    for (size_t i = 0; i < len; ++i) {
+      data[i] = packed_data + (size_t) offset[i];
+      data_len[i] = (size_t) offset[i + 1] - (size_t) offset[i];
+    }
+  } else if (TYPEOF(keys) == RAWSXP) {
     data[0] = (char*) RAW(keys);
     data_len[0] = length(keys);
   } else if (TYPEOF(keys) == STRSXP) {
@@ -101,6 +161,202 @@ SEXP raw_string_to_sexp(const char *str, size_t len, return_as as) {
   return ret;
 }
 
+void collector_init(collector *c) {
+  c->n = 0;
+  c->bytes = 0;
+  c->chunk_size = COLLECTOR_CHUNK_MIN;
+  c->head = NULL;
+  c->tail = NULL;
+  c->native = false;
+  c->failed = false;
+}
+
+void collector_init_native(collector *c) {
+  collector_init(c);
+  c->native = true;
+}
+
+// Each element is stored as its length followed by its bytes, and
+// never spans two chunks.
+void collector_push(collector *c, const char *data, size_t len) {
+  size_t need = sizeof(size_t) + len;
+  collector_chunk *chunk = c->tail;
+  if (c->failed) {
+    return;
+  }
+  if (chunk == NULL || chunk->size - chunk->used < need) {
+    size_t size = c->chunk_size < need ? need : c->chunk_size;
+    size_t bytes = sizeof(collector_chunk) + size;
+    chunk = (collector_chunk*) (c->native ? malloc(bytes) : R_alloc(bytes, 1));
+    if (chunk == NULL) {
+      c->failed = true;
+      return;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->data = (char*) (chunk + 1);
+    if (c->tail == NULL) {
+      c->head = chunk;
+    } else {
+      c->tail->next = chunk;
+    }
+    c->tail = chunk;
+    if (c->chunk_size < COLLECTOR_CHUNK_MAX) {
+      c->chunk_size *= 2;
+    }
+  }
+  char *dest = chunk->data + chunk->used;
+  memcpy(dest, &len, sizeof(size_t));
+  if (len > 0) {
+    memcpy(dest + sizeof(size_t), data, len);
+  }
+  chunk->used += need;
+  c->n++;
+  c->bytes += len;
+}
+
+// Move the contents of 'other' onto the end of 'c' (without copying);
+// both must be of the same kind.  'other' is left empty.
+void collector_append(collector *c, collector *other) {
+  if (other->head == NULL) {
+    return;
+  }
+  if (c->tail == NULL) {
+    c->head = other->head;
+  } else {
+    c->tail->next = other->head;
+  }
+  c->tail = other->tail;
+  c->n += other->n;
+  c->bytes += other->bytes;
+  c->failed = c->failed || other->failed;
+  other->head = other->tail = NULL;
+  other->n = other->bytes = 0;
+}
+
+void collector_free(collector *c) {
+  if (c->native) {
+    collector_chunk *chunk = c->head;
+    while (chunk != NULL) {
+      collector_chunk *next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+  }
+  c->head = c->tail = NULL;
+  c->n = c->bytes = 0;
+}
+
+// Returns a character vector if 'as' is AS_STRING, otherwise a list
+// (following the conventions of raw_string_to_sexp).
+SEXP collector_finalize(collector *c, return_as as) {
+  bool as_string = as == AS_STRING;
+  SEXP ret = PROTECT(allocVector(as_string ? STRSXP : VECSXP, c->n));
+  size_t i = 0;
+  for (collector_chunk *chunk = c->head; chunk != NULL; chunk = chunk->next) {
+    for (size_t pos = 0; pos < chunk->used; ++i) {
+      size_t len;
+      memcpy(&len, chunk->data + pos, sizeof(size_t));
+      const char *data = chunk->data + pos + sizeof(size_t);
+      if (as_string) {
+        SET_STRING_ELT(ret, i, mkCharLen(data, len));
+      } else {
+        SET_VECTOR_ELT(ret, i, raw_string_to_sexp(data, len, as));
+      }
+      pos += sizeof(size_t) + len;
+    }
+  }
+  UNPROTECT(1);
+  return ret;
+}
+
+SEXP collector_finalize_packed(collector *c) {
+  char *data;
+  double *offset;
+  SEXP ret = PROTECT(packed_alloc(c->n, c->bytes, &data, &offset));
+
+  size_t i = 0, at = 0;
+  offset[0] = 0;
+  for (collector_chunk *chunk = c->head; chunk != NULL; chunk = chunk->next) {
+    for (size_t pos = 0; pos < chunk->used; ++i) {
+      size_t len;
+      memcpy(&len, chunk->data + pos, sizeof(size_t));
+      if (len > 0) {
+        memcpy(data + at, chunk->data + pos + sizeof(size_t), len);
+      }
+      at += len;
+      offset[i + 1] = at;
+      pos += sizeof(size_t) + len;
+    }
+  }
+  UNPROTECT(1);
+  return ret;
+}
+
+// Allocate a packed object for n strings totalling 'bytes' bytes; the
+// caller fills in the data and the n + 1 offsets.
+SEXP packed_alloc(size_t n, size_t bytes, char **data, double **offset) {
+  SEXP ret = PROTECT(allocVector(VECSXP, 2));
+  SEXP r_data = PROTECT(allocVector(RAWSXP, bytes));
+  SEXP r_offset = PROTECT(allocVector(REALSXP, n + 1));
+  SET_VECTOR_ELT(ret, 0, r_data);
+  SET_VECTOR_ELT(ret, 1, r_offset);
+  *data = (char*) RAW(r_data);
+  *offset = REAL(r_offset);
+
+  SEXP nms = PROTECT(allocVector(STRSXP, 2));
+  SET_STRING_ELT(nms, 0, mkChar("data"));
+  SET_STRING_ELT(nms, 1, mkChar("offset"));
+  setAttrib(ret, R_NamesSymbol, nms);
+  setAttrib(ret, R_ClassSymbol, mkString("leveldb_packed"));
+  UNPROTECT(4);
+  return ret;
+}
+
+bool is_packed(SEXP x) {
+  return TYPEOF(x) == VECSXP && inherits(x, "leveldb_packed");
+}
+
+size_t get_packed(SEXP x, const char **data, const double **offset) {
+  if (!is_packed(x) || LENGTH(x) != 2 ||
+      TYPEOF(VECTOR_ELT(x, 0)) != RAWSXP ||
+      TYPEOF(VECTOR_ELT(x, 1)) != REALSXP ||
+      LENGTH(VECTOR_ELT(x, 1)) < 1) {
+    Rf_error("Invalid leveldb_packed object");
+  }
+  SEXP r_data = VECTOR_ELT(x, 0), r_offset = VECTOR_ELT(x, 1);
+  size_t n = (size_t) xlength(r_offset) - 1;
+  *data = (const char*) RAW(r_data);
+  *offset = REAL(r_offset);
+  double total = (double) xlength(r_data);
+  for (size_t i = 0; i < n; ++i) {
+    double from = (*offset)[i], to = (*offset)[i + 1];
+    if (!(from >= 0 && to >= from && to <= total)) {
+      Rf_error("Invalid leveldb_packed object (corrupt offsets)");
+    }
+  }
+  return n;
+}
+
+SEXP packed_to_list(SEXP x, return_as as) {
+  const char *data;
+  const double *offset;
+  size_t n = get_packed(x, &data, &offset);
+  bool as_string = as == AS_STRING;
+  SEXP ret = PROTECT(allocVector(as_string ? STRSXP : VECSXP, n));
+  for (size_t i = 0; i < n; ++i) {
+    size_t from = (size_t) offset[i], len = (size_t) offset[i + 1] - from;
+    if (as_string) {
+      SET_STRING_ELT(ret, i, mkCharLen(data + from, len));
+    } else {
+      SET_VECTOR_ELT(ret, i, raw_string_to_sexp(data + from, len, as));
+    }
+  }
+  UNPROTECT(1);
+  return ret;
+}
+
 // Same as from ring
 bool scalar_logical(SEXP x) {
   if (TYPEOF(x) == LGLSXP && LENGTH(x) == 1) {
@@ -1,3 +1,6 @@
+#ifndef RLEVELDB_SUPPORT_H
+#define RLEVELDB_SUPPORT_H
+
 #include <stdbool.h>
 #include <R.h>
 #include <Rinternals.h>
@@ -8,10 +11,58 @@ typedef enum return_as {
   AS_ANY
 } return_as;
 
+// A growable store of byte strings (keys or values), filled in a
+// single pass over an iterator and then converted into an R vector
+// in one go.  Storage is a linked list of chunks that double in size
+// (up to COLLECTOR_CHUNK_MAX) so growth is amortised and nothing is
+// ever copied twice.  Chunks are allocated with R_alloc so they are
+// released at the end of the .Call, even on error.  A "native"
+// collector (collector_init_native) instead uses malloc so that it can
+// be filled from a worker thread; it must be released with
+// collector_free, and sets 'failed' if it runs out of memory.
+typedef struct collector_chunk {
+  struct collector_chunk *next;
+  size_t size;
+  size_t used;
+  char *data;
+} collector_chunk;
+
+typedef struct collector {
+  size_t n;
+  size_t bytes;
+  size_t chunk_size;
+  collector_chunk *head;
+  collector_chunk *tail;
+  bool native;
+  bool failed;
+} collector;
+
+#define COLLECTOR_CHUNK_MIN 4096
+#define COLLECTOR_CHUNK_MAX 1048576
+
+void collector_init(collector *c);
+void collector_init_native(collector *c);
+void collector_push(collector *c, const char *data, size_t len);
+void collector_append(collector *c, collector *other);
+void collector_free(collector *c);
+SEXP collector_finalize(collector *c, return_as as);
+SEXP collector_finalize_packed(collector *c);
+
+// A "packed" vector of byte strings: a single raw vector holding all
+// the data back-to-back plus a numeric vector of n + 1 offsets
+// (double so that we are not limited to 2GB of data).
+SEXP packed_alloc(size_t n, size_t bytes, char **data, double **offset);
+bool is_packed(SEXP x);
+size_t get_packed(SEXP x, const char **data, const double **offset);
+SEXP packed_to_list(SEXP x, return_as as);
+
 size_t get_key(SEXP key, const char **key_data);
 size_t get_value(SEXP value, const char **value_data);
 size_t get_keys(SEXP keys, const char ***key_data, size_t **key_len);
+void get_values(SEXP values, size_t num_key, const char ***value_data,
+                size_t **value_len);
 size_t get_starts_with(SEXP starts_with, const char **starts_with_data);
+size_t get_bound(SEXP bound, const char **bound_data, const char *name);
 
 bool is_raw_string(const char* str, size_t len, return_as as);
 SEXP raw_string_to_sexp(const char *str, size_t len, return_as as);
@@ -19,3 +70,4 @@ bool scalar_logical(SEXP x);
 return_as to_return_as(SEXP x);
 size_t scalar_size(SEXP x);
 const char * scalar_character(SEXP x);
+#endif
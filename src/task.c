@@ -0,0 +1,171 @@
+#include "task.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+struct rleveldb_task {
+  task_work *work;
+  void *data;
+
+  pthread_mutex_t lock;
+  pthread_cond_t finished; // signalled when the work function returns
+
+  // Everything below is protected by the lock
+  bool done;
+  bool cancel;
+  double progress[4]; // keys, bytes, total_keys, total_bytes
+};
+
+// The R thread's view of a task while it polls; 'checked' is set once
+// the interrupt check has passed, so that a failure after that point
+// must have come from the progress callback.
+typedef struct task_poll_data {
+  double progress[4];
+  SEXP r_progress;
+  bool checked;
+} task_poll_data;
+
+static void* task_thread(void *data);
+static void task_poll(void *data);
+static void task_report(const double *progress, SEXP r_progress);
+
+bool task_cancelled(rleveldb_task *task) {
+  pthread_mutex_lock(&task->lock);
+  bool ret = task->cancel;
+  pthread_mutex_unlock(&task->lock);
+  return ret;
+}
+
+void task_progress(rleveldb_task *task, double keys, double bytes) {
+  pthread_mutex_lock(&task->lock);
+  task->progress[0] = keys;
+  task->progress[1] = bytes;
+  pthread_mutex_unlock(&task->lock);
+}
+
+void task_total(rleveldb_task *task, double keys, double bytes) {
+  pthread_mutex_lock(&task->lock);
+  task->progress[2] = keys;
+  task->progress[3] = bytes;
+  pthread_mutex_unlock(&task->lock);
+}
+
+void task_check_progress(SEXP r_progress) {
+  if (r_progress != R_NilValue && !isFunction(r_progress)) {
+    Rf_error("Expected a function for 'progress'");
+  }
+}
+
+task_status task_run(task_work *work, void *data, SEXP r_progress) {
+  task_check_progress(r_progress);
+  rleveldb_task task;
+  memset(&task, 0, sizeof(rleveldb_task));
+  task.work = work;
+  task.data = data;
+  for (size_t i = 0; i < 4; ++i) {
+    task.progress[i] = NAN;
+  }
+  pthread_mutex_init(&task.lock, NULL);
+  pthread_cond_init(&task.finished, NULL);
+
+  task_status status = TASK_DONE;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, task_thread, &task) != 0) {
+    // Fall back on doing the work here, uninterruptibly
+    task_thread(&task);
+  } else {
+    pthread_mutex_lock(&task.lock);
+    while (!task.done) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      double secs = deadline.tv_nsec / 1e9 + TASK_POLL;
+      deadline.tv_sec += (time_t) secs;
+      deadline.tv_nsec = (long) ((secs - (time_t) secs) * 1e9);
+      pthread_cond_timedwait(&task.finished, &task.lock, &deadline);
+      if (task.done) {
+        break;
+      }
+      // R_ToplevelExec catches the longjmp from an interrupt or an
+      // error in the callback, which would otherwise leave the worker
+      // running with nobody to clean up after it.
+      task_poll_data poll;
+      memcpy(poll.progress, task.progress, sizeof(poll.progress));
+      poll.r_progress = r_progress;
+      poll.checked = false;
+      pthread_mutex_unlock(&task.lock);
+      bool ok = R_ToplevelExec(task_poll, &poll);
+      pthread_mutex_lock(&task.lock);
+      if (!ok) {
+        status = poll.checked ? TASK_CALLBACK_ERROR : TASK_INTERRUPTED;
+        task.cancel = true;
+        break;
+      }
+    }
+    while (!task.done) {
+      pthread_cond_wait(&task.finished, &task.lock);
+    }
+    pthread_mutex_unlock(&task.lock);
+    pthread_join(thread, NULL);
+  }
+  pthread_cond_destroy(&task.finished);
+  pthread_mutex_destroy(&task.lock);
+
+  // The final report can throw too, but the caller may be holding
+  // the result of the work.
+  if (status == TASK_DONE && r_progress != R_NilValue) {
+    task_poll_data poll;
+    memcpy(poll.progress, task.progress, sizeof(poll.progress));
+    poll.r_progress = r_progress;
+    poll.checked = true;
+    if (!R_ToplevelExec(task_poll, &poll)) {
+      status = TASK_CALLBACK_ERROR;
+    }
+  }
+  return status;
+}
+
+void task_error(task_status status, const char *what, bool completed) {
+  const char *reason = status == TASK_INTERRUPTED ?
+    "interrupted" : "stopped by an error in the progress callback";
+  if (completed) {
+    Rf_error("%s was %s, but had already completed", what, reason);
+  } else {
+    Rf_error("%s was %s", what, reason);
+  }
+}
+
+static void* task_thread(void *data) {
+  rleveldb_task *task = (rleveldb_task*) data;
+  task->work(task, task->data);
+  pthread_mutex_lock(&task->lock);
+  task->done = true;
+  pthread_cond_signal(&task->finished);
+  pthread_mutex_unlock(&task->lock);
+  return NULL;
+}
+
+static void task_poll(void *data) {
+  task_poll_data *poll = (task_poll_data*) data;
+  if (!poll->checked) {
+    R_CheckUserInterrupt();
+    poll->checked = true;
+  }
+  if (poll->r_progress != R_NilValue) {
+    task_report(poll->progress, poll->r_progress);
+  }
+}
+
+static void task_report(const double *progress, SEXP r_progress) {
+  const char *names[] = {"keys", "bytes", "total_keys", "total_bytes"};
+  SEXP r_value = PROTECT(allocVector(REALSXP, 4));
+  SEXP r_names = PROTECT(allocVector(STRSXP, 4));
+  for (int i = 0; i < 4; ++i) {
+    REAL(r_value)[i] = isnan(progress[i]) ? NA_REAL : progress[i];
+    SET_STRING_ELT(r_names, i, mkChar(names[i]));
+  }
+  setAttrib(r_value, R_NamesSymbol, r_names);
+  SEXP call = PROTECT(lang2(r_progress, r_value));
+  eval(call, R_GlobalEnv);
+  UNPROTECT(3);
+}
@@ -0,0 +1,47 @@
+#ifndef RLEVELDB_TASK_H
+#define RLEVELDB_TASK_H
+
+#include <stdbool.h>
+#include <R.h>
+#include <Rinternals.h>
+
+// Runs a long native operation (a compaction, a big write, a scan
+// over a large range) on a worker thread, so that the R thread is
+// free to notice interrupts and to report progress while it waits.
+// The work function must not use the R API; it owns any leveldb
+// objects it creates (iterators and the like), and should look at
+// task_cancelled every so often and clean up and return early if it
+// is set.  Some leveldb calls can't be cancelled, in which case the
+// R thread waits for them to finish.
+typedef struct rleveldb_task rleveldb_task;
+typedef void task_work(rleveldb_task *task, void *data);
+
+typedef enum task_status {
+  TASK_DONE,
+  TASK_INTERRUPTED,
+  TASK_CALLBACK_ERROR
+} task_status;
+
+// How often the R thread wakes up, and how many keys a worker should
+// process between calls to task_progress / task_cancelled
+#define TASK_POLL 0.1
+#define TASK_CHECK_EVERY 1024
+
+// Called from the worker thread
+bool task_cancelled(rleveldb_task *task);
+void task_progress(rleveldb_task *task, double keys, double bytes);
+void task_total(rleveldb_task *task, double keys, double bytes);
+
+// Called from the R thread.  'r_progress' is NULL or an R function,
+// called every TASK_POLL seconds (and once at the end) with a numeric
+// vector c(keys, bytes, total_keys, total_bytes), with NA for anything
+// that the operation does not know.  If the user interrupts, or the
+// callback throws, the work is cancelled and task_run returns once
+// the worker has finished, so that the caller can release what it
+// holds before calling task_error.  task_run only throws if
+// 'r_progress' is invalid, which callers holding native resources
+// should check first with task_check_progress.
+void task_check_progress(SEXP r_progress);
+task_status task_run(task_work *work, void *data, SEXP r_progress);
+void task_error(task_status status, const char *what, bool completed);
+#endif
@@ -0,0 +1,219 @@
+#include "writer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Queued operations above this multiple of batch_bytes make the R
+// thread wait for the writer to catch up, bounding memory use.
+#define WRITER_BACKLOG 4
+
+struct rleveldb_writer {
+  leveldb_t *db;
+  leveldb_writeoptions_t *writeoptions;
+  size_t batch_keys;
+  size_t batch_bytes;
+  double delay;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work;    // signalled when there is work for the thread
+  pthread_cond_t written; // signalled after each batch is written
+
+  // Everything below is protected by the lock
+  leveldb_writebatch_t *pending;
+  leveldb_writebatch_t *spare;
+  size_t pending_n;
+  size_t pending_bytes;
+  struct timespec pending_since;
+  bool flush_requested;
+  bool stop;
+  char *err;
+  writer_status status;
+};
+
+static void* writer_thread(void *data);
+static bool writer_ready(const rleveldb_writer *w);
+static void timespec_add(struct timespec *t, double seconds);
+
+rleveldb_writer* writer_create(leveldb_t *db, bool sync, size_t batch_keys,
+                               size_t batch_bytes, double delay) {
+  rleveldb_writer *w = (rleveldb_writer*) calloc(1, sizeof(rleveldb_writer));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->db = db;
+  w->writeoptions = leveldb_writeoptions_create();
+  leveldb_writeoptions_set_sync(w->writeoptions, sync);
+  w->batch_keys = batch_keys;
+  w->batch_bytes = batch_bytes;
+  w->delay = delay;
+  w->pending = leveldb_writebatch_create();
+  w->spare = leveldb_writebatch_create();
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->work, NULL);
+  pthread_cond_init(&w->written, NULL);
+  if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+    pthread_cond_destroy(&w->written);
+    pthread_cond_destroy(&w->work);
+    pthread_mutex_destroy(&w->lock);
+    leveldb_writebatch_destroy(w->spare);
+    leveldb_writebatch_destroy(w->pending);
+    leveldb_writeoptions_destroy(w->writeoptions);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+// Queue n puts (or deletes, if value_data is NULL), returning the
+// sequence number of the last one; once status.written reaches this
+// number the operations are in the database.
+uint64_t writer_enqueue(rleveldb_writer *w, size_t n,
+                        const char **key_data, const size_t *key_len,
+                        const char **value_data, const size_t *value_len) {
+  pthread_mutex_lock(&w->lock);
+  while (w->err == NULL &&
+         w->pending_bytes >= WRITER_BACKLOG * w->batch_bytes) {
+    pthread_cond_signal(&w->work);
+    pthread_cond_wait(&w->written, &w->lock);
+  }
+  if (w->pending_n == 0 && n > 0) {
+    clock_gettime(CLOCK_REALTIME, &w->pending_since);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (value_data == NULL) {
+      leveldb_writebatch_delete(w->pending, key_data[i], key_len[i]);
+      w->pending_bytes += key_len[i];
+    } else {
+      leveldb_writebatch_put(w->pending, key_data[i], key_len[i],
+                             value_data[i], value_len[i]);
+      w->pending_bytes += key_len[i] + value_len[i];
+    }
+  }
+  w->pending_n += n;
+  w->status.submitted += n;
+  uint64_t seq = w->status.submitted;
+  if (n > 0) {
+    pthread_cond_signal(&w->work);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return seq;
+}
+
+// Wait until everything queued so far has been written
+uint64_t writer_flush(rleveldb_writer *w) {
+  pthread_mutex_lock(&w->lock);
+  uint64_t target = w->status.submitted;
+  while (w->status.written < target) {
+    w->flush_requested = true;
+    pthread_cond_signal(&w->work);
+    pthread_cond_wait(&w->written, &w->lock);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return target;
+}
+
+// Write anything still queued, stop the thread and free everything.
+// Any error must be retrieved (with writer_error) beforehand.
+void writer_close(rleveldb_writer *w) {
+  pthread_mutex_lock(&w->lock);
+  w->stop = true;
+  pthread_cond_signal(&w->work);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+
+  pthread_cond_destroy(&w->written);
+  pthread_cond_destroy(&w->work);
+  pthread_mutex_destroy(&w->lock);
+  leveldb_writebatch_destroy(w->spare);
+  leveldb_writebatch_destroy(w->pending);
+  leveldb_writeoptions_destroy(w->writeoptions);
+  if (w->err != NULL) {
+    leveldb_free(w->err);
+  }
+  free(w);
+}
+
+// The first error encountered while writing, or NULL.  After an error
+// nothing further is written (queued operations are dropped).
+const char* writer_error(rleveldb_writer *w) {
+  pthread_mutex_lock(&w->lock);
+  const char *err = w->err;
+  pthread_mutex_unlock(&w->lock);
+  return err;
+}
+
+void writer_get_status(rleveldb_writer *w, writer_status *status) {
+  pthread_mutex_lock(&w->lock);
+  *status = w->status;
+  pthread_mutex_unlock(&w->lock);
+}
+
+static void* writer_thread(void *data) {
+  rleveldb_writer *w = (rleveldb_writer*) data;
+  pthread_mutex_lock(&w->lock);
+  while (true) {
+    while (!w->stop && !writer_ready(w)) {
+      if (w->pending_n == 0) {
+        pthread_cond_wait(&w->work, &w->lock);
+      } else {
+        struct timespec deadline = w->pending_since;
+        timespec_add(&deadline, w->delay);
+        if (pthread_cond_timedwait(&w->work, &w->lock, &deadline) != 0) {
+          break; // timed out, so write what we have
+        }
+      }
+    }
+    if (w->pending_n == 0) {
+      if (w->stop) {
+        break;
+      }
+      continue;
+    }
+
+    leveldb_writebatch_t *batch = w->pending;
+    w->pending = w->spare;
+    w->spare = NULL;
+    uint64_t seq = w->status.submitted;
+    size_t bytes = w->pending_bytes;
+    bool failed = w->err != NULL;
+    w->pending_n = 0;
+    w->pending_bytes = 0;
+    w->flush_requested = false;
+    pthread_mutex_unlock(&w->lock);
+
+    char *err = NULL;
+    if (!failed) {
+      leveldb_write(w->db, w->writeoptions, batch, &err);
+    }
+    leveldb_writebatch_clear(batch);
+
+    pthread_mutex_lock(&w->lock);
+    w->spare = batch;
+    w->status.written = seq;
+    if (err != NULL) {
+      w->err = err;
+    } else if (!failed) {
+      w->status.batches++;
+      w->status.bytes += bytes;
+    }
+    pthread_cond_broadcast(&w->written);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+static bool writer_ready(const rleveldb_writer *w) {
+  return w->pending_n > 0 &&
+    (w->flush_requested ||
+     w->pending_n >= w->batch_keys ||
+     w->pending_bytes >= w->batch_bytes ||
+     w->delay <= 0);
+}
+
+static void timespec_add(struct timespec *t, double seconds) {
+  time_t whole = (time_t) seconds;
+  long nsec = t->tv_nsec + (long) ((seconds - whole) * 1e9);
+  t->tv_sec += whole + nsec / 1000000000L;
+  t->tv_nsec = nsec % 1000000000L;
+}
@@ -0,0 +1,34 @@
+#ifndef RLEVELDB_WRITER_H
+#define RLEVELDB_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <leveldb/c.h>
+
+// An asynchronous writer: puts and deletes are queued into a pending
+// write batch by the R thread and written by a background thread,
+// which coalesces everything queued since its last write into a
+// single batch (group commit).  A batch is written once it holds
+// batch_keys operations or batch_bytes bytes, once delay seconds
+// have passed since its first operation was queued, or when a flush
+// is requested.  None of these functions use the R API.
+typedef struct rleveldb_writer rleveldb_writer;
+
+typedef struct writer_status {
+  uint64_t submitted; // operations queued
+  uint64_t written;   // operations written (or dropped after an error)
+  uint64_t batches;   // batches written
+  uint64_t bytes;     // bytes written
+} writer_status;
+
+rleveldb_writer* writer_create(leveldb_t *db, bool sync, size_t batch_keys,
+                               size_t batch_bytes, double delay);
+uint64_t writer_enqueue(rleveldb_writer *w, size_t n,
+                        const char **key_data, const size_t *key_len,
+                        const char **value_data, const size_t *value_len);
+uint64_t writer_flush(rleveldb_writer *w);
+void writer_close(rleveldb_writer *w);
+const char* writer_error(rleveldb_writer *w);
+void writer_get_status(rleveldb_writer *w, writer_status *status);
+#endif